@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Platform.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Helpers for 64-bit square sets (bitboards). Bit i is board index i, ie. (i & 7, i >> 3).
+
+// Bitboard with only the given square index set
+#define SQUARE_BIT(i) ((UINT64)1 << (i))
+
+// Number of squares in the set.
+inline int popcount(UINT64 b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(b);
+#elif defined(_MSC_VER)
+	return (int)(__popcnt((unsigned int)b) + __popcnt((unsigned int)(b >> 32)));
+#else
+	return __builtin_popcountll(b);
+#endif
+}
+
+// Index of the lowest square in a non-empty set.
+inline int lsbIndex(UINT64 b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long i;
+	_BitScanForward64(&i, b);
+	return (int)i;
+#elif defined(_MSC_VER)
+	unsigned long i;
+	if (_BitScanForward(&i, (unsigned long)b)) return (int)i;
+	_BitScanForward(&i, (unsigned long)(b >> 32));
+	return (int)i + 32;
+#else
+	return __builtin_ctzll(b);
+#endif
+}
+
+// Index of the highest square in a non-empty set.
+inline int msbIndex(UINT64 b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long i;
+	_BitScanReverse64(&i, b);
+	return (int)i;
+#elif defined(_MSC_VER)
+	unsigned long i;
+	if (_BitScanReverse(&i, (unsigned long)(b >> 32))) return (int)i + 32;
+	_BitScanReverse(&i, (unsigned long)b);
+	return (int)i;
+#else
+	return 63 - __builtin_clzll(b);
+#endif
+}
+
+// Remove the lowest square from a non-empty set and return its index.
+inline int popLsb(UINT64& b) {
+	int i = lsbIndex(b);
+	b &= b - 1;
+	return i;
+}
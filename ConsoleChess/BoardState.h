@@ -1,8 +1,11 @@
 #pragma once
 #include <algorithm>
-#include <Windows.h>
+#include <stdexcept>
+#include "Platform.h"
 #include "IVec2.h"
 #include "Byte88.h"
+#include "Bitboard.h"
+#include "Zobrist.h"
 
 #define PIECE_ID      0b00001111	// Bitmask for a Piece's ID
 #define PIECE_TEAM    0b00010000	// Bitmask for a Piece's team
@@ -34,26 +37,48 @@ struct Piece
 	}
 };
 
-/// Byte88 subclass to represent chess board
+// Maximum number of squares a single move may change
+#define MAX_MOVE_CHANGES 16
+
+// Squares changed by a move and their previous bytes, so the move can be undone.
+// Covers the moved piece, captures, flag updates, en passant and castling rook moves alike.
+struct MoveRecord {
+	byte count;
+	byte pos[MAX_MOVE_CHANGES];
+	byte old[MAX_MOVE_CHANGES];
+};
+
+/// Byte88 subclass to represent chess board.
+/// Next to the 64 piece bytes it keeps bitboards of the occupied squares per team
+/// and per piece id, and a Zobrist hash of the pieces. These are updated incrementally by set(),
+/// so pieces must be written through set(); code writing the bytes directly must call rebuildBitboards().
 struct BoardState : Byte88
 {
+	UINT64 teamBB[2];	// Squares occupied by each team
+	UINT64 pieceBB[16];	// Squares occupied by each piece id (both teams)
+	UINT64 spTempBB;	// Squares whose piece has the PIECE_SPTEMP flag
+	UINT64 hash;		// Zobrist hash of the piece bytes (see Zobrist.h)
+
+	MoveRecord* journal;	// If set, set() records the previous byte of every square it changes
+
 	// Create empty byte8x8.
-	BoardState() : Byte88() {};
+	BoardState() : Byte88(), teamBB{ }, pieceBB{ }, spTempBB(0), hash(0), journal(NULL) {};
 
-	// Create copy of byte8x8.
-	BoardState(const BoardState& b)
+	// Create copy of byte8x8. The journal is not copied.
+	BoardState(const BoardState& b) : journal(NULL)
 	{
-		memcpy_s(data, 64, b.data, 64);
+		*this = b;
 	}
 
 	// Create a BoardState filled with the same value.
-	BoardState(byte b)
+	BoardState(byte b) : journal(NULL)
 	{
 		std::fill_n(data, 64, b);
+		rebuildBitboards();
 	}
 
 	// Create a BoardState from a bit board with custom LOW and HIGH bytes. 
-	BoardState(UINT64 bboard, byte low, byte high) : Byte88()
+	BoardState(UINT64 bboard, byte low, byte high) : Byte88(), journal(NULL)
 	{
 		for (int i = 0; i < 64; i++)
 		{	// Get bit at position i (LSB) and assign to low/high
@@ -61,12 +86,141 @@ struct BoardState : Byte88
 			// Shift board to the right, making space for next bit
 			bboard >>= 1;
 		}
+		rebuildBitboards();
 	}
 
 	// Create a BoardState from a pointer. Unsafe.
-	BoardState(byte* ptr)
+	BoardState(const byte* ptr) : journal(NULL)
 	{
 		memcpy_s(data, 64, ptr, 64);
+		rebuildBitboards();
+	}
+
+	// Copy the pieces and bitboards, keeping this board's journal.
+	BoardState& operator=(const BoardState& b)
+	{
+		memcpy_s(data, 64, b.data, 64);
+		memcpy_s(teamBB, sizeof(teamBB), b.teamBB, sizeof(teamBB));
+		memcpy_s(pieceBB, sizeof(pieceBB), b.pieceBB, sizeof(pieceBB));
+		spTempBB = b.spTempBB;
+		hash = b.hash;
+		return *this;
+	}
+
+	// Recompute all bitboards and the hash from the piece bytes.
+	void rebuildBitboards()
+	{
+		std::fill_n(teamBB, 2, 0);
+		std::fill_n(pieceBB, 16, 0);
+		spTempBB = 0;
+		hash = computeHash();
+
+		for (int i = 0; i < 64; i++)
+		{
+			if (data[i] == 0) continue;
+			if (data[i] & PIECE_SPTEMP) spTempBB |= SQUARE_BIT(i);
+
+			teamBB[(data[i] & PIECE_TEAM) >> 4] |= SQUARE_BIT(i);
+			pieceBB[data[i] & PIECE_ID] |= SQUARE_BIT(i);
+		}
+	}
+
+	// Zobrist hash of the piece bytes, computed from scratch.
+	UINT64 computeHash() const
+	{
+		UINT64 h = 0;
+		for (int i = 0; i < 64; i++) h ^= Zobrist.key(i, data[i]);
+
+		return h;
+	}
+
+	// Set the byte at a given index, updating the bitboards and hash.
+	void set(int pos, byte b)
+	{
+		byte old = data[pos];
+		UINT64 bit = SQUARE_BIT(pos);
+
+		if (journal != NULL)
+		{
+			// A move that changes more squares could not be undone
+			if (journal->count == MAX_MOVE_CHANGES) throw std::runtime_error("Move changes more than MAX_MOVE_CHANGES squares");
+
+			journal->pos[journal->count] = pos;
+			journal->old[journal->count] = old;
+			journal->count++;
+		}
+
+		if (old != 0)
+		{
+			teamBB[(old & PIECE_TEAM) >> 4] &= ~bit;
+			pieceBB[old & PIECE_ID] &= ~bit;
+			spTempBB &= ~bit;
+		}
+		if (b != 0)
+		{
+			teamBB[(b & PIECE_TEAM) >> 4] |= bit;
+			pieceBB[b & PIECE_ID] |= bit;
+			if (b & PIECE_SPTEMP) spTempBB |= bit;
+		}
+		hash ^= Zobrist.key(pos, old) ^ Zobrist.key(pos, b);
+		data[pos] = b;
+	}
+
+	// Set the byte at a given position, updating the bitboards.
+	void set(IVec2 pos, byte b)
+	{
+		set(pos.y << 3 | pos.x, b);
+	}
+
+	// Squares occupied by any piece.
+	UINT64 occupied() const
+	{
+		return teamBB[0] | teamBB[1];
+	}
+
+	// True if no piece is at the given index.
+	bool isEmpty(int pos) const
+	{
+		return !(occupied() & SQUARE_BIT(pos));
+	}
+
+	// Squares occupied by the pieces of a given id and team.
+	UINT64 pieces(byte id, bool team) const
+	{
+		return pieceBB[id] & teamBB[team];
+	}
+
+	// Number of pieces of a given id and team.
+	int count(byte id, bool team) const
+	{
+		return popcount(pieces(id, team));
+	}
+
+	// Only the read-only index operators are exposed and the compound operators of Byte88 are deleted,
+	// so writes go through set(). The binary operators still work on a Byte88 copy of the bytes.
+	BoardState& operator+=(const Byte88&) = delete;
+	BoardState& operator-=(const Byte88&) = delete;
+	BoardState& operator*=(const Byte88&) = delete;
+	BoardState& operator/=(const Byte88&) = delete;
+	BoardState& operator|=(const Byte88&) = delete;
+	BoardState& operator|=(byte) = delete;
+	BoardState& operator&=(const Byte88&) = delete;
+	BoardState& operator&=(byte) = delete;
+	BoardState& operator^=(const Byte88&) = delete;
+	BoardState& operator^=(byte) = delete;
+	BoardState& operator>>=(const Byte88&) = delete;
+	BoardState& operator>>=(byte) = delete;
+	BoardState& operator<<=(const Byte88&) = delete;
+	BoardState& operator<<=(byte) = delete;
+
+	byte operator[](int index) const
+	{
+		return data[index];
+	}
+
+	byte operator[](IVec2 pos) const
+	{
+		return data[pos.y << 3 | pos.x];
 	}
 
 	// Get a Piece structure at a given index.
@@ -85,13 +239,12 @@ struct BoardState : Byte88
 	// Set the Piece structure at a given index.
 	void setPiece(int pos, Piece p)
 	{
-		data[pos] = p.getByte();
+		set(pos, p.getByte());
 	}
 
 	// Set the Piece structure at a given position.
 	void setPiece(IVec2 pos, Piece p)
 	{
-		// Shift y by 3 bits and OR with x to get a unique index from 0-63
-		data[pos.y << 3 | pos.x] = p.getByte();
+		set(pos, p.getByte());
 	}
 };
\ No newline at end of file
@@ -1,18 +1,177 @@
 #pragma once
 
 #include "IVec2.h"
-#include <Windows.h>
+#include "Platform.h"
+#include "Bitboard.h"
+
+// The element-wise operators run on vectors: two 32-byte AVX2 vectors per Byte88 if the compiler
+// targets AVX2, four 16-byte SSE2 vectors on other x86 targets, and eight 64-bit words
+// (SIMD within a register) elsewhere. Define BYTE88_NO_SIMD to always use the 64-bit words.
+#if defined(BYTE88_NO_SIMD)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define BYTE88_AVX2
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BYTE88_SSE2
+#endif
 
 // Macro to convert a board vector position to its index
 #define POS_TO_INDEX(pos) ((pos).y << 3 | (pos).x)
 
+// Per-byte operations on one vector of a Byte88.
+// Byte shifts clamp the count to 8, which clears every bit.
+namespace Byte88Lanes {
+#if defined(BYTE88_AVX2)
+	typedef __m256i Vec;
+	const int Width = 32;	// Bytes per vector
+
+	inline Vec load(const byte* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	inline void store(byte* p, Vec v) { _mm256_storeu_si256((__m256i*)p, v); }
+	inline Vec splat(byte b) { return _mm256_set1_epi8((char)b); }
+
+	inline Vec bitAnd(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+	inline Vec bitOr(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+	inline Vec bitXor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+	inline Vec add(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+	inline Vec sub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+
+	// There are no byte shifts: shift 16-bit lanes and mask off the bits crossing bytes
+	inline Vec shr(Vec a, int n) {
+		n = (std::min)(n, 8);
+		return _mm256_and_si256(_mm256_srl_epi16(a, _mm_cvtsi32_si128(n)), splat(0xFF >> n));
+	}
+	inline Vec shl(Vec a, int n) {
+		n = (std::min)(n, 8);
+		return _mm256_and_si256(_mm256_sll_epi16(a, _mm_cvtsi32_si128(n)), splat((byte)(0xFF << n)));
+	}
+
+	// Bit i is set if byte i of a and b are equal
+	inline UINT64 equalMask(Vec a, Vec b) { return (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)); }
+
+#elif defined(BYTE88_SSE2)
+	typedef __m128i Vec;
+	const int Width = 16;
+
+	inline Vec load(const byte* p) { return _mm_loadu_si128((const __m128i*)p); }
+	inline void store(byte* p, Vec v) { _mm_storeu_si128((__m128i*)p, v); }
+	inline Vec splat(byte b) { return _mm_set1_epi8((char)b); }
+
+	inline Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+	inline Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+	inline Vec bitXor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+	inline Vec add(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+	inline Vec sub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+
+	inline Vec shr(Vec a, int n) {
+		n = (std::min)(n, 8);
+		return _mm_and_si128(_mm_srl_epi16(a, _mm_cvtsi32_si128(n)), splat(0xFF >> n));
+	}
+	inline Vec shl(Vec a, int n) {
+		n = (std::min)(n, 8);
+		return _mm_and_si128(_mm_sll_epi16(a, _mm_cvtsi32_si128(n)), splat((byte)(0xFF << n)));
+	}
+
+	inline UINT64 equalMask(Vec a, Vec b) { return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)); }
+
+#else
+	typedef UINT64 Vec;
+	const int Width = 8;
+
+	const UINT64 Low7 = 0x7F7F7F7F7F7F7F7F;
+	const UINT64 High = 0x8080808080808080;
+
+	inline Vec load(const byte* p) { Vec v; memcpy(&v, p, 8); return v; }
+	inline void store(byte* p, Vec v) { memcpy(p, &v, 8); }
+	inline Vec splat(byte b) { return 0x0101010101010101 * b; }
+
+	inline Vec bitAnd(Vec a, Vec b) { return a & b; }
+	inline Vec bitOr(Vec a, Vec b) { return a | b; }
+	inline Vec bitXor(Vec a, Vec b) { return a ^ b; }
+
+	// Add the low 7 bits, so no carry crosses a byte, then fix up the top bits
+	inline Vec add(Vec a, Vec b) { return ((a & Low7) + (b & Low7)) ^ ((a ^ b) & High); }
+	inline Vec sub(Vec a, Vec b) { return ((a | High) - (b & Low7)) ^ ((a ^ ~b) & High); }
+
+	inline Vec shr(Vec a, int n) {
+		n = (std::min)(n, 8);
+		return (a >> n) & splat(0xFF >> n);
+	}
+	inline Vec shl(Vec a, int n) {
+		n = (std::min)(n, 8);
+		return (a << n) & splat((byte)(0xFF << n));
+	}
+
+	// The top bit of a byte of t is set if the byte differs; the multiply gathers the eight flags
+	inline UINT64 equalMask(Vec a, Vec b) {
+		UINT64 d = a ^ b;
+		UINT64 t = ((d & Low7) + Low7) | d;
+		return ((~t & High) >> 7) * 0x0102040810204080 >> 56;
+	}
+#endif
+
+	inline Vec bitNot(Vec a) { return bitXor(a, splat(0xFF)); }
+	inline Vec neg(Vec a) { return sub(splat(0), a); }
+
+	// Bytes set to 0xFF where a and b are equal, 0 elsewhere
+#if defined(BYTE88_AVX2)
+	inline Vec equalBytes(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+#elif defined(BYTE88_SSE2)
+	inline Vec equalBytes(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+#else
+	inline Vec equalBytes(Vec a, Vec b) {
+		UINT64 d = a ^ b;
+		UINT64 t = ((d & Low7) + Low7) | d;
+		return ((~t & High) >> 7) * 0xFF;
+	}
+#endif
+
+	// Bytes of a where mask is set, of b elsewhere
+	inline Vec select(Vec mask, Vec a, Vec b) { return bitOr(bitAnd(mask, a), bitAnd(bitNot(mask), b)); }
+}
+
 // Small struct equivalent to an 8x8 byte array.
 // Used to store sprites, boards, etc.
 struct Byte88 {
 	byte data[64]; // Internal data of the Byte88
 
+private:
+	typedef Byte88Lanes::Vec Vec;
+
+	// Tag of the constructor leaving the bytes uninitialized, for results that are overwritten anyway
+	struct NoInit {};
+	Byte88(NoInit) {}
+
+	// Write op applied to the bytes of a and b at every index.
+	template <Vec (*Op)(Vec, Vec)>
+	void combine(const byte* a, const byte* b) {
+		for (int i = 0; i < 64; i += Byte88Lanes::Width)
+			Byte88Lanes::store(data + i, Op(Byte88Lanes::load(a + i), Byte88Lanes::load(b + i)));
+	}
+
+	// Write op applied to every byte of a and the byte b.
+	template <Vec (*Op)(Vec, Vec)>
+	void combine(const byte* a, byte b) {
+		Vec v = Byte88Lanes::splat(b);
+		for (int i = 0; i < 64; i += Byte88Lanes::Width)
+			Byte88Lanes::store(data + i, Op(Byte88Lanes::load(a + i), v));
+	}
+
+	template <Vec (*Op)(Vec, int)>
+	void shift(const byte* a, int n) {
+		for (int i = 0; i < 64; i += Byte88Lanes::Width)
+			Byte88Lanes::store(data + i, Op(Byte88Lanes::load(a + i), n));
+	}
+
+	template <Vec (*Op)(Vec)>
+	void map(const byte* a) {
+		for (int i = 0; i < 64; i += Byte88Lanes::Width)
+			Byte88Lanes::store(data + i, Op(Byte88Lanes::load(a + i)));
+	}
+
+public:
 	Byte88() : data{} {};
-	
+
 	Byte88(const Byte88& b) {
 		memcpy_s(data, 64, b.data, 64);
 	}
@@ -21,193 +180,246 @@ struct Byte88 {
 		std::fill_n(data, 64, b);
 	};
 
-	// Create a Byte88 from a bit board with custom LOW and HIGH bytes. 
+	// Create a Byte88 from a bit board with custom LOW and HIGH bytes.
 	Byte88(UINT64 bboard, byte low, byte high) : data{ } {
-		for (int i = 0; i < 64; i++) {	
+		for (int i = 0; i < 64; i++) {
 			data[i] = (bboard & 1) ? high : low;
 			bboard >>= 1;
 		}
 	}
 
 	// Create a byte8x8 from a pointer. Unsafe...
-	Byte88(byte* ptr) {
+	Byte88(const byte* ptr) {
 		memcpy_s(data, 64, ptr, 64);
 	}
 
-	Byte88& operator+= (Byte88 & b) {										
-		for (int i = 0; i < 64; i++)		
-		{									
-			data[i] += b.data[i];		
-		}									
-		return *this;						
-	}	
-	
-	Byte88 operator+ (Byte88 & b) const {			
-		Byte88 cpy = Byte88(*this);
-		cpy += b;
-		return cpy;
+	Byte88& operator= (const Byte88& b) {
+		memcpy_s(data, 64, b.data, 64);
+		return *this;
+	}
+
+	// ELEMENT-WISE OPERATORS
+	// The binary operators write their result directly instead of copying this object first.
+	// Multiplication, division and per-element shifts have no byte vector instructions and stay scalar.
+
+	Byte88& operator+= (const Byte88& b) {
+		combine<Byte88Lanes::add>(data, b.data);
+		return *this;
+	}
+
+	Byte88 operator+ (const Byte88& b) const {
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::add>(data, b.data);
+		return res;
 	}
 
 	Byte88 operator-() const {
-		Byte88 cpy = Byte88(*this);
-		for (int i = 0; i < 64; i++) cpy.data[i] = -data[i];
-		return cpy;
+		Byte88 res = Byte88(NoInit());
+		res.map<Byte88Lanes::neg>(data);
+		return res;
 	}
 
-	Byte88& operator-= (Byte88& b) {
-		for (int i = 0; i < 64; i++) data[i] -= b.data[i];
+	Byte88& operator-= (const Byte88& b) {
+		combine<Byte88Lanes::sub>(data, b.data);
 		return *this;
 	}
 
-	Byte88 operator- (Byte88& b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy -= b;
-		return cpy;
+	Byte88 operator- (const Byte88& b) const {
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::sub>(data, b.data);
+		return res;
 	}
 
-	Byte88& operator*= (Byte88& b) {
-		for (int i = 0; i < 64; i++) 
+	Byte88& operator*= (const Byte88& b) {
+		for (int i = 0; i < 64; i++) data[i] *= b.data[i];
 		return *this;
 	}
 
-	Byte88 operator* (Byte88& b) const {
+	Byte88 operator* (const Byte88& b) const {
 		Byte88 cpy = Byte88(*this);
 		cpy *= b;
 		return cpy;
 	}
 
-	Byte88& operator/= (Byte88& b) {
+	Byte88& operator/= (const Byte88& b) {
 		for (int i = 0; i < 64; i++) data[i] /= b.data[i];
 		return *this;
 	}
 
-	Byte88 operator/ (Byte88& b) const {
+	Byte88 operator/ (const Byte88& b) const {
 		Byte88 cpy = Byte88(*this);
 		cpy /= b;
 		return cpy;
 	}
 
-	Byte88& operator|= (Byte88& b) {
-		for (int i = 0; i < 64; i++) data[i] |= b.data[i];
+	Byte88& operator|= (const Byte88& b) {
+		combine<Byte88Lanes::bitOr>(data, b.data);
 		return *this;
 	}
 
-	Byte88 operator| (Byte88& b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy |= b;
-		return cpy;
+	Byte88 operator| (const Byte88& b) const {
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::bitOr>(data, b.data);
+		return res;
 	}
 
 	Byte88& operator|= (byte b) {
-		for (int i = 0; i < 64; i++) data[i] |= b;
+		combine<Byte88Lanes::bitOr>(data, b);
 		return *this;
 	}
 
 	Byte88 operator| (byte b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy |= b;
-		return cpy;
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::bitOr>(data, b);
+		return res;
 	}
 
-	Byte88& operator&= (Byte88& b) {
-		for (int i = 0; i < 64; i++) data[i] &= b.data[i];
+	Byte88& operator&= (const Byte88& b) {
+		combine<Byte88Lanes::bitAnd>(data, b.data);
 		return *this;
 	}
 
-	Byte88 operator& (Byte88& b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy &= b;
-		return cpy;
+	Byte88 operator& (const Byte88& b) const {
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::bitAnd>(data, b.data);
+		return res;
 	}
 
 	Byte88& operator&= (byte b) {
-		for (int i = 0; i < 64; i++) data[i] &= b;
+		combine<Byte88Lanes::bitAnd>(data, b);
 		return *this;
 	}
 
 	Byte88 operator& (byte b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy &= b;
-		return cpy;
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::bitAnd>(data, b);
+		return res;
 	}
 
-	Byte88& operator^= (Byte88& b) {
-		for (int i = 0; i < 64; i++) data[i] ^= b.data[i];
+	Byte88& operator^= (const Byte88& b) {
+		combine<Byte88Lanes::bitXor>(data, b.data);
 		return *this;
 	}
 
-	Byte88 operator^ (Byte88& b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy ^= b;
-		return cpy;
+	Byte88 operator^ (const Byte88& b) const {
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::bitXor>(data, b.data);
+		return res;
 	}
 
 	Byte88& operator^= (byte b) {
-		for (int i = 0; i < 64; i++) data[i] ^= b;
+		combine<Byte88Lanes::bitXor>(data, b);
 		return *this;
 	}
 
 	Byte88 operator^ (byte b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy ^= b;
-		return cpy;
+		Byte88 res = Byte88(NoInit());
+		res.combine<Byte88Lanes::bitXor>(data, b);
+		return res;
 	}
 
-	Byte88& operator>>= (Byte88& b) {
+	Byte88& operator>>= (const Byte88& b) {
 		for (int i = 0; i < 64; i++) data[i] >>= b.data[i];
 
 		return *this;
 	}
 
-	Byte88 operator>> (Byte88& b) const {
+	Byte88 operator>> (const Byte88& b) const {
 		Byte88 cpy = Byte88(*this);
 		cpy >>= b;
 		return cpy;
 	}
 
 	Byte88& operator>>= (byte b) {
-		for (int i = 0; i < 64; i++) data[i] >>= b;
+		shift<Byte88Lanes::shr>(data, b);
 		return *this;
 	}
 
 	Byte88 operator>> (byte b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy >>= b;
-		return cpy;
+		Byte88 res = Byte88(NoInit());
+		res.shift<Byte88Lanes::shr>(data, b);
+		return res;
 	}
 
-	Byte88& operator<<= (Byte88& b) {
+	Byte88& operator<<= (const Byte88& b) {
 		for (int i = 0; i < 64; i++) data[i] <<= b.data[i];
 		return *this;
 	}
 
-	Byte88 operator<< (Byte88& b) const {
+	Byte88 operator<< (const Byte88& b) const {
 		Byte88 cpy = Byte88(*this);
 		cpy <<= b;
 		return cpy;
 	}
 
 	Byte88& operator<<= (byte b) {
-		for (int i = 0; i < 64; i++) data[i] <<= b;
+		shift<Byte88Lanes::shl>(data, b);
 		return *this;
 	}
 
 	Byte88 operator<< (byte b) const {
-		Byte88 cpy = Byte88(*this);
-		cpy <<= b;
-		return cpy;
+		Byte88 res = Byte88(NoInit());
+		res.shift<Byte88Lanes::shl>(data, b);
+		return res;
 	}
 
 	Byte88 operator~() const {
-		Byte88 cpy = Byte88(*this);
-		for (int i = 0; i < 64; i++) cpy.data[i] = ~cpy.data[i];
+		Byte88 res = Byte88(NoInit());
+		res.map<Byte88Lanes::bitNot>(data);
+		return res;
+	}
 
-		return cpy;
+	// MASK OPERATIONS
+	// Compare all bytes at once and return a bitboard: bit i is set if byte i matches (see Bitboard.h).
+
+	// Indices whose byte equals b.
+	UINT64 maskEqual(byte b) const {
+		Vec v = Byte88Lanes::splat(b);
+		UINT64 res = 0;
+
+		for (int i = 0; i < 64; i += Byte88Lanes::Width)
+			res |= Byte88Lanes::equalMask(Byte88Lanes::load(data + i), v) << i;
+		return res;
+	}
+
+	// Indices whose byte equals the byte of b at the same index.
+	UINT64 maskEqual(const Byte88& b) const {
+		UINT64 res = 0;
+
+		for (int i = 0; i < 64; i += Byte88Lanes::Width)
+			res |= Byte88Lanes::equalMask(Byte88Lanes::load(data + i), Byte88Lanes::load(b.data + i)) << i;
+		return res;
+	}
+
+	// Indices whose byte is not zero.
+	UINT64 maskNonzero() const {
+		return ~maskEqual((byte)0);
+	}
+
+	// Indices whose byte has any of the given bits set.
+	UINT64 maskAny(byte bits) const {
+		return ~(*this & bits).maskEqual((byte)0);
+	}
+
+	int countNonzero() const {
+		return popcount(maskNonzero());
+	}
+
+	int countEqual(byte b) const {
+		return popcount(maskEqual(b));
+	}
+
+	bool operator== (const Byte88& b) const {
+		return maskEqual(b) == ~(UINT64)0;
+	}
+
+	bool operator!= (const Byte88& b) const {
+		return !(*this == b);
 	}
 
 	// INDEX OPERATORS
 	// Index operators are defined for both integer and IVec2 positions.
-	// One version returns a reference to the value so that one can 
+	// One version returns a reference to the value so that one can
 	// assign an index expression, ex. byte88[5] = 3. There is also a const version
 	// so that one can properly use to constant type Byte88 object.
 
@@ -226,4 +438,4 @@ struct Byte88 {
 	byte operator[](IVec2 pos) const {
 		return data[pos.y << 3 | pos.x];
 	}
-};
\ No newline at end of file
+};
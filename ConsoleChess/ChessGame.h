@@ -1,11 +1,15 @@
 #pragma once
 
-#include <Windows.h>
+#include "Platform.h"
 #include <vector>
 
 #include "GameWindow.h"
+#include "ChessRules.h"
 #include "PieceDef.h"
 #include "BoardState.h"
+#include "Engine.h"
+#include "MoveWorker.h"
+#include "Fen.h"
 
 // Sprite used for potential moves and king in check marks
 static const Byte88 TgtSqrSprite = Byte88(new byte[64] {
@@ -46,6 +50,26 @@ enum Layers {
 	LayerRestart = 6
 };
 
+// Sprites drawn by ChessGame::redraw, prepared once when the game is created
+// so drawing a square is a copy of a cached entry.
+struct SpriteAtlas {
+	Byte88 pieces[2][16];	// Piece sprites by team, then piece id (white uses the lighter colors)
+	Byte88 empty;
+	Byte88 moveTarget;
+	Byte88 check;
+
+	SpriteAtlas() : empty(Transparent << 4) {};
+
+	void build(const PieceDef* const* pieceDefs) {
+		for (int i = 0; i < 16; i++) {
+			pieces[0][i] = pieceDefs[i] ? pieceDefs[i]->sprite : empty;
+			pieces[1][i] = pieceDefs[i] ? (pieceDefs[i]->sprite >> 1) & 0xf0 : empty; // Use bitwise to switch to white colors
+		}
+		moveTarget = TgtSqrSprite & 0xe0;
+		check = TgtSqrSprite;
+	}
+};
+
 // Enum defining the different game states
 enum GameState {
 	InProgress,
@@ -54,28 +78,41 @@ enum GameState {
 	Promoting
 };
 
-class ChessGame {
+class ChessGame : public ChessRules {
 private:
 	GameWindow window;
 
 	IVec2 hoverSqr;
 	IVec2 selectedSqr;
-	Byte88 attackedCrits; 
-	Byte88 legalMoves[64];
-	BoardState prvBoard;
 
 	int gameState;
 
+	SearchInfo engineInfo;	// Latest progress of the engine, shown in the side panel
+	Layer textLayer;	// The side panel is drawn here, then copied to LayerText so only changed tiles get dirty
+	SpriteAtlas sprites;
+
+	MoveWorker moveWorker;	// Generates the legal moves of each new position off the input thread
+	bool movesPending;	// legalMoves and attackedCrits are not known yet for the position
+	UINT64 shownTargets;	// Move and check markers on the layers, as of the last redraw
+	UINT64 shownChecks;
+	std::vector<MOUSE_EVENT_RECORD> queuedClicks;	// Clicks on the board while the moves were pending
+
 	void init(std::vector<PieceDef*> pieces) {
-		
-		for (int i = 0; i < pieces.size(); i++) {
-			pieceDefs[pieces[i]->id] = pieces[i];
-		}
+		setPieces(pieces);
+		sprites.build(pieceDefs);
+		enginePlays[0] = enginePlays[1] = false;
+		movesPending = false;
+		shownTargets = shownChecks = 0;
 
 		// Create game window and setup color-related stuff
 		window = GameWindow();
 		window.onKeyEvent = [this](KEY_EVENT_RECORD evt) { onKey(evt); };
 		window.onMouseEvent = [this](MOUSE_EVENT_RECORD evt) { onMouse(evt); };
+		window.onIdle = [this]() { onIdle(); };
+		window.onDraw = [this]() { redraw(); };
+		window.idleInterval = 30;
+		window.frameInterval = 1000 / 60;
+		moveWorker.onReady = [this]() { window.wake(); };
 
 		window.colormap[Transparent] = 0x000000;
 		window.colormap[WhiteFill] = 0xe8f1ff;
@@ -98,184 +135,111 @@ private:
 		window.alphaColor = Transparent << 4;
 
 		//TBC
-		window.setup(128, 64, 14, 13);
+		window.setup(128, 64, 14, 13, 8);	// 7 layers and the text panel
 
-		window.layers.push_back(Layer(64, 64, Transparent << 4));
-		window.layers[LayerBoard].transform([](byte v, IVec2 pos) {
-			bool isWhite = (pos.x / 8 & 1) == (pos.y / 8 & 1);
-			return (isWhite ? SquareWhite : SquareBlack) << 4;
-		});
+		window.addLayer(64, 64, Transparent << 4);
+		for (int sq = 0; sq < 64; sq++) {
+			IVec2 start = IVec2(sq & 7, sq >> 3) * 8;
+			bool isWhite = (start.x / 8 & 1) == (start.y / 8 & 1);
+			window.layers[LayerBoard].fill(start, start + IVec2(8, 8), (isWhite ? SquareWhite : SquareBlack) << 4);
+		}
 
-		window.layers.push_back(Layer(64, 64, Transparent << 4));
-		window.layers.push_back(Layer(64, 64, Transparent << 4));
-		window.layers.push_back(Layer(64, 64, Transparent << 4));
-		window.layers.push_back(Layer(64, 64, Transparent << 4));
-		window.layers.push_back(Layer(64, 64, Transparent << 4, IVec2(64, 0)));
+		window.addLayer(64, 64, Transparent << 4);
+		window.addLayer(64, 64, Transparent << 4);
+		window.addLayer(64, 64, Transparent << 4);
+		window.addLayer(64, 64, Transparent << 4);
+		window.addLayer(64, 64, Transparent << 4, IVec2(64, 0));
 
-		window.layers.push_back(Layer(64, 64, Transparent << 4, IVec2(64, 0)));
+		window.addLayer(64, 64, Transparent << 4, IVec2(64, 0));
+		textLayer = window.makeLayer(64, 64, Transparent << 4, IVec2(64, 0));
 		window.spriteText("RESTART", LayerRestart, IVec2(4, 52), WhiteFill << 4, BlackFill << 4, BlackOutline << 4);
 	}
 
-public:
-
-	PieceDef* pieceDefs[16];	
-	BoardState board;
-	BoardState startingBoard;
+	// Show the engine's progress in the side panel: depth, speed and the start of the best line.
+	void drawEngineInfo() {
+		char line[16];
 
-	byte currTeam;
+		snprintf(line, sizeof(line), "DEPTH %d", engineInfo.depth);
+		window.spriteText(line, textLayer, IVec2(0, 16));
+		snprintf(line, sizeof(line), "NPS %s", shortCount(engineInfo.nps()).c_str());
+		window.spriteText(line, textLayer, IVec2(0, 24));
 
-	// Class constructor (default)
-	ChessGame(std::vector<PieceDef*> pieces) : startingBoard(), pieceDefs{ } {
-		init(pieces);
-	};
-	// Constructor (w/state)
-	ChessGame(std::vector<PieceDef*> pieces, BoardState bstate) : startingBoard(bstate), pieceDefs{ } {
-		init(pieces);
-	};
-
-	bool isAttacked(IVec2 pos) {
-		Piece tgt = board.getPiece(pos);
-
-		if (tgt.id == 0) return false; 
-
-		for (int i = 0; i < 8; i++) {
-			for (int j = 0; j < 8; j++) {
-
-				IVec2 v = IVec2(i, j);
-				Piece att = board.getPiece(v);
-
-				if (att.id != 0 && att.team != tgt.team && pieceDefs[att.id]->isValidMove(v, pos, board))
-					return true;
-			}
+		for (int i = 0; i < 2 && i < (int)engineInfo.pv.size(); i++) {
+			const SearchMove& m = engineInfo.pv[i];
+			window.spriteText(moveName(m.move.startPos(), m.move.endPos(), m.promoteId).c_str(), textLayer, IVec2(0, 32 + 8 * i));
 		}
-		return false;
 	}
 
-	// Make a move (without updating the rendered chess board).
-	bool makeMove(IVec2 start, IVec2 end) {
-		prvBoard = BoardState(board);
-
-		board &= ~PIECE_SPTEMP;
-		Piece p = board.getPiece(start);
-		bool promote = pieceDefs[p.id]->makeMove(start, end, board);
-		currTeam ^= 1;
+	// Start the engine if it plays the side to move.
+	void startEngineTurn() {
+		if (gameState != InProgress || movesPending || !enginePlays[currTeam]) return;
 
-		return promote;
+		engineInfo = SearchInfo();
+		engine.start(*this);
 	}
 
-	// Undo a move (without updating the rendered chess board).
-	void undoMove() {
-		BoardState temp = BoardState(board);
-		board = prvBoard;
-		prvBoard = temp;
+	// Play the best move of a finished search.
+	void playEngineMove(const SearchInfo& result) {
+		if (result.pv.empty()) return;
 
-		currTeam ^= 1;
-	}
+		const SearchMove& m = result.pv[0];
+		if (makeMove(m.move.startPos(), m.move.endPos()) && m.promoteId != 0) promote(m.move.endPos(), m.promoteId);
 
-	// Return true if any critical pieces are under attack
-	bool inCheck(bool team) {
-		for (int i = 0; i < 8; i++) {
-			for (int j = 0; j < 8; j++) {
-				IVec2 v = IVec2(i, j);
-				Piece p = board.getPiece(v);
-
-				if (p.id == 0 || p.team != team)  continue; 
-
-				if (pieceDefs[p.id]->critical && isAttacked(v))  return true; 
-			}
-		}
-
-		return false;
-	}
-
-	int computeChecks(bool team) {
-		attackedCrits = Byte88();
-		int cnt = 0;
-		
-		for (int i = 0; i < 8; i++) {
-			for (int j = 0; j < 8; j++) {
-				IVec2 v = IVec2(i, j);
-				Piece p = board.getPiece(v);
-
-				if (p.id == 0 || p.team != team) continue; 
-
-				if (pieceDefs[p.id]->critical && isAttacked(v)){
-					attackedCrits[v] = 1;
-					cnt++;
-				}
-			}
-		}
-
-		return cnt;
+		finalizeMove();
 	}
 
-	int calculateLegalMoves(bool team) {
-		int cnt = 0;
-
-		for (int k = 0; k < 64; k++) {
-			IVec2 v = IVec2(k & 7, k >> 3);
-			Piece p = board.getPiece(k);
-			legalMoves[k] = Byte88();
-
-			if (p.team != team || p.id == 0) continue;
-
-			for (int i = 0; i < 8; i++) {
-				for (int j = 0; j < 8; j++) {
-					IVec2 u = IVec2(i, j);
+public:
 
-					if (pieceDefs[p.id]->isValidMove(v, u, board)) {
-						makeMove(v, u);
-						if (!inCheck(team)) {
-							legalMoves[k][u] = 1;
-							cnt++;
-						}
+	BoardState startingBoard;
+	bool enginePlays[2];	// Per team: true if the engine plays that side
+	Engine engine;
 
-						undoMove();
-					}
-				}
-			}
-		}
 
-		return cnt;
-	}
+	// Class constructor (default)
+	ChessGame(std::vector<PieceDef*> pieces) : startingBoard() {
+		init(pieces);
+	};
+	// Constructor (w/state)
+	ChessGame(std::vector<PieceDef*> pieces, BoardState bstate) : startingBoard(bstate) {
+		init(pieces);
+	};
 
 	// Updates the graphical interface.
+	// Layers are rewritten a square at a time, so unchanged squares stay clean for the compositor.
 	void redraw() {
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
 		window.layers[LayerSelected].transform([this](byte v, IVec2 pos) {
 			pos /= 8;
 			return ((pos == selectedSqr)? SquareSelected : (pos == hoverSqr) ? SquareHover : Transparent) << 4;
 		});
 
-		window.layers[LayerMoves].setAll(Transparent << 4);
-		window.layers[LayerCheck].setAll(Transparent << 4);
-		window.layers[LayerPiece].setAll(Transparent << 4);
+		// Markers are only rewritten on the squares where they appear or go away
+		UINT64 targets = (selectedSqr.x != -1) ? legalMoves[selectedSqr.y << 3 | selectedSqr.x] : 0;
+		UINT64 changed = targets ^ shownTargets;
+		while (changed) {
+			int i = popLsb(changed);
+			window.layers[LayerMoves].setTile(IVec2(i & 7, i >> 3), (targets & SQUARE_BIT(i)) ? sprites.moveTarget : sprites.empty);
+		}
+		changed = attackedCrits ^ shownChecks;
+		while (changed) {
+			int i = popLsb(changed);
+			window.layers[LayerCheck].setTile(IVec2(i & 7, i >> 3), (attackedCrits & SQUARE_BIT(i)) ? sprites.check : sprites.empty);
+		}
+		shownTargets = targets;
+		shownChecks = attackedCrits;
 
 		for (int i = 0; i < 8; i++) {
 			for (int j = 0; j < 8; j++) {
 				IVec2 pos = IVec2(i, j);
 				Piece piece = board.getPiece(pos);
-				Byte88 sprite;
-
-				if (selectedSqr.x != -1 && legalMoves[selectedSqr.y << 3 | selectedSqr.x][pos]) {
-					sprite = TgtSqrSprite & 0xe0;
-					window.layers[LayerMoves].drawSprite(sprite, 8 * pos, Transparent << 4);
-				}
-
-				if (attackedCrits[pos]) {
-					window.layers[LayerCheck].drawSprite(TgtSqrSprite, 8 * pos, Transparent << 4);
-				}
-
-				if (piece.id != 0) {
-					sprite = Byte88(pieceDefs[piece.id]->sprite);
-					if (piece.team) { sprite = (sprite >> 1) & 0xf0; } // Use bitwise to switch to white colors
-					window.layers[LayerPiece].drawSprite(sprite, 8 * pos, Transparent << 4);
-				}
+				window.layers[LayerPiece].setTile(pos, sprites.pieces[piece.team][piece.id]);
 			}
 		}
 
-		window.layers[LayerText].setAll(Transparent << 4);
+		textLayer.setAll(Transparent << 4);
 		if (gameState == Stalemate) {
-			window.spriteText("DRAW!", LayerText, IVec2(12, 16));
+			window.spriteText("DRAW!", textLayer, IVec2(12, 16));
 		}
 		else if (gameState != Promoting) {
 			// Flip team if game state is ended
@@ -283,43 +247,150 @@ public:
 			byte fill = (team ? WhiteFill : BlackFill) << 4;
 			byte outline = (team ? WhiteOutline : BlackOutline) << 4;
 
-			window.spriteText(team ? "WHITE" : "BLACK", LayerText, IVec2(12, 8), Transparent << 4, fill, outline);
+			window.spriteText(team ? "WHITE" : "BLACK", textLayer, IVec2(12, 8), Transparent << 4, fill, outline);
 
-			const char* msg = (gameState == InProgress) ? " CLICK \nTO MOVE" : " WINS! ";
-			window.spriteText(msg, LayerText, IVec2(4, 16));
+			// Until the legal moves arrive it is not known whether the side to move can move, so there is no message
+			if (!movesPending) {
+				if (gameState == InProgress && enginePlays[currTeam]) {
+					drawEngineInfo();
+				}
+				else {
+					const char* msg = (gameState == InProgress) ? " CLICK \nTO MOVE" : " WINS! ";
+					window.spriteText(msg, textLayer, IVec2(4, 16));
+				}
+			}
 		}
 		else {
-			window.spriteText("PROMOTE", LayerText, IVec2(4, 0));
+			window.spriteText("PROMOTE", textLayer, IVec2(4, 0));
 			int j = 0;
 
 			for (int i = 0; i < 16; i++) {
-				if (pieceDefs[i] == NULL) continue;
+				if (!canPromoteTo(selectedSqr, i)) continue;
 
-				if (board.getPiece(selectedSqr).id == i) continue; 
-
-				if (pieceDefs[i]->critical) continue; 
-
-				Byte88 sprite = (pieceDefs[i]->sprite >> 1) & 0xf0;
-				window.layers[LayerText].drawSprite(sprite, IVec2(13 + 10 * (j % 4), 10 + 10 * (j / 4)), Transparent << 4);
+				textLayer.drawSprite(sprites.pieces[1][i], IVec2(13 + 10 * (j % 4), 10 + 10 * (j / 4)), Transparent << 4);
 
 				j++;
 			}
 		}
+		window.layers[LayerText].replaceData(textLayer);
+
+		window.invalidate(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+	}
 
-		window.invalidate();
+	// Wait until the legal moves of the position are known, handling the clicks queued until then.
+	void awaitMoves() {
+		LegalMoveSet moves;
+		while (movesPending && moveWorker.wait(moves)) applyMoves(moves);
+	}
+
+	// How the legal moves of the positions were found so far
+	MoveWorkerStats moveStats() {
+		return moveWorker.stats();
+	}
+
+	// Redraw at the end of the current tick, at most once per frame however many changes are made until then.
+	void requestRedraw() {
+		window.requestFrame();
+	}
+
+	// Draw the requested redraw now, ex. after calling the event handlers directly. Returns false if there was none.
+	bool flush() {
+		return window.drawFrame();
+	}
+
+	// Limit the redraws to fps per second, 0 for no limit.
+	void setFrameRate(int fps) {
+		window.frameInterval = (fps > 0) ? 1000 / fps : 0;
 	}
 
 	void beginGame() {
+		engine.stop();
 		board = BoardState(startingBoard);
 		gameState = InProgress;
 		currTeam = 1;
 		hoverSqr = IVec2(-1, -1);
 		selectedSqr = IVec2(-1, -1);
-		attackedCrits = Byte88();
-		prvBoard = BoardState();
-		calculateLegalMoves(currTeam);
+		clearHistory();
+		queuedClicks.clear();
+
+		requestMoves();
+		requestRedraw();
+	}
+
+	// Set up a position from FEN as if it was just reached. Returns false if the FEN is invalid.
+	bool loadPosition(const char* fen) {
+		engine.stop();
+		if (!loadFen(fen, *this)) return false;
+
+		hoverSqr = IVec2(-1, -1);
+		finalizeMove();
+		return true;
+	}
+
+	// Record the key and mouse events to a file, or play one back instead of the console input.
+	bool recordInput(const char* path) {
+		return window.startRecording(path);
+	}
+
+	bool replayInput(const char* path, bool realtime) {
+		return window.startReplay(path, realtime);
+	}
+
+	bool replayingInput() const {
+		return window.replaying();
+	}
+
+	// Time from the first key or mouse event shown by the last frame showing input to the end of that frame, in microseconds
+	double inputLatencyUs() const {
+		return window.latencyUs;
+	}
+
+	size_t inputEvents() const {
+		return window.dispatched;
+	}
+
+	// Frames that showed input, and mouse moves dropped for a later one
+	size_t inputFrames() const {
+		return window.inputFrames;
+	}
+
+	size_t coalescedMoves() const {
+		return window.coalesced;
+	}
+
+	int state() const {
+		return gameState;
+	}
+
+	// Call a function with the timing of every frame drawn from now on (NULL to stop).
+	void onFrame(std::function<void(const FrameStats&)> func) {
+		window.onFrame = func;
+	}
+
+	// Wait for and handle the next input events, then poll the engine.
+	void tick() {
+		window.eventTick();
+	}
+
+	// Replace the output of the window, ex. with a FramebufferOutput to render without a console.
+	void setOutput(FrameOutput* out) {
+		window.setOutput(out);
+	}
 
-		redraw();
+	// Draw with ANSI escape sequences instead of console API calls, if the console supports them.
+	bool useVirtualTerminal() {
+		return window.useVirtualTerminal();
+	}
+
+	// Let the engine play a side or give it back to the mouse.
+	void setEngine(bool team, bool on) {
+		enginePlays[team] = on;
+
+		if (team == currTeam) {
+			if (on) startEngineTurn();
+			else engine.stop();
+		}
+		requestRedraw();
 	}
 
 	void mainloop() {
@@ -335,19 +406,64 @@ public:
 		if (evt.wVirtualKeyCode == 'Q') exit(0);
 		
 		if (evt.wVirtualKeyCode == 'R')	beginGame();
+
+		// Toggle the engine for white / black
+		if (evt.bKeyDown && evt.wVirtualKeyCode == 'W') setEngine(1, !enginePlays[1]);
+		if (evt.bKeyDown && evt.wVirtualKeyCode == 'B') setEngine(0, !enginePlays[0]);
 	}
 
-	//Cleans up after move completion
-	void finalizeMove() {
-		Byte88 prvCrits = Byte88(attackedCrits);
-		int nLegalMoves = calculateLegalMoves(currTeam);
-		int nChecks = computeChecks(currTeam);
+	// Poll the engine: show its progress, and play its move once the search is done.
+	void onIdle() {
+		LegalMoveSet moves;
+		if (moveWorker.poll(moves)) applyMoves(moves);
+
+		if (engine.pollInfo(engineInfo)) requestRedraw();
+
+		SearchInfo result;
+		if (engine.poll(result)) playEngineMove(result);
+	}
+
+	// Get the legal moves of the new position from the worker: at once if it precomputed them, else the board is
+	// redrawn without move and check highlights until onIdle collects them.
+	void requestMoves() {
+		LegalMoveSet moves;
+		if (moveWorker.request(*this, moves)) {
+			applyMoves(moves);
+			return;
+		}
 
-		if (nLegalMoves == 0) gameState = (nChecks != 0) ? Checkmate : Stalemate;
+		// Ends a promotion; the state of the position is set by applyMoves
+		movesPending = true;
+		gameState = InProgress;
+		for (int k = 0; k < 64; k++) legalMoves[k] = 0;
+		legalMoveList.clear();
+		attackedCrits = 0;
+	}
+
+	// Take the legal moves of the current position, then handle the clicks that waited for them.
+	void applyMoves(const LegalMoveSet& moves) {
+		setLegalMoves(moves.targets);
+		attackedCrits = moves.checks;
+
+		if (moves.checkmate()) gameState = Checkmate;
+		else if (moves.stalemate()) gameState = Stalemate;
 		else gameState = InProgress;
-		
+
+		movesPending = false;
+		startEngineTurn();
+		requestRedraw();
+
+		// A click may make a move, after which onMouse queues the rest again
+		std::vector<MOUSE_EVENT_RECORD> clicks;
+		clicks.swap(queuedClicks);
+		for (const MOUSE_EVENT_RECORD& evt : clicks) onMouse(evt);
+	}
+
+	//Cleans up after move completion
+	void finalizeMove() {
 		selectedSqr = IVec2(-1, -1);
-		redraw();
+		requestMoves();
+		requestRedraw();
 	}
 
 	void onMouse(MOUSE_EVENT_RECORD evt) {
@@ -360,13 +476,18 @@ public:
 				return;
 			}
 
-			if (gameState == InProgress && boardPos.in88Square() && selectedSqr != boardPos) {
+			// Moves are validated once the worker has the legal moves
+			if (movesPending) {
+				queuedClicks.push_back(evt);
+			}
+
+			else if (gameState == InProgress && !enginePlays[currTeam] && boardPos.in88Square() && selectedSqr != boardPos) {
 				if (board[boardPos] == 0 || board.getPiece(boardPos).team != currTeam) {
-					if (selectedSqr.in88Square() && legalMoves[selectedSqr.y << 3 | selectedSqr.x][boardPos]) {
+					if (selectedSqr.in88Square() && (legalMoves[selectedSqr.y << 3 | selectedSqr.x] & SQUARE_BIT(POS_TO_INDEX(boardPos)))) {
 						if (makeMove(selectedSqr, boardPos)) {
 							gameState = Promoting;
 							selectedSqr = boardPos;
-							redraw();
+							requestRedraw();
 
 						} else {
 							finalizeMove();
@@ -374,23 +495,19 @@ public:
 					}	
 				} else {
 					selectedSqr = boardPos;
-					redraw();
+					requestRedraw();
 				}
 			}
 
 			else if (gameState == Promoting) {
 				int j = 0;
 				for (int i = 0; i < 16; i++) {
-					if (pieceDefs[i] == NULL) continue; 
-
-					if (board.getPiece(selectedSqr).id == i) continue; 
-
-					if (pieceDefs[i]->critical) continue; 
+					if (!canPromoteTo(selectedSqr, i)) continue;
 
 					IVec2 v = IVec2(77 + 10 * (j % 4), 10 + 10 * (j / 4));
 
 					if ((curPos - v).in88Square()) {
-						board[selectedSqr] = (board[selectedSqr] & PIECE_TEAM) | pieceDefs[i]->id;
+						promote(selectedSqr, pieceDefs[i]->id);
 						finalizeMove();
 						break;
 					}
@@ -403,7 +520,7 @@ public:
 		if (evt.dwEventFlags & MOUSE_MOVED && hoverSqr != boardPos) {
 			if (hoverSqr.in88Square() || boardPos.in88Square()) {
 				hoverSqr = boardPos.in88Square() ? boardPos : IVec2(-1, -1);
-				redraw();
+				requestRedraw();
 			}
 		}
 	}
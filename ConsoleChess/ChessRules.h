@@ -0,0 +1,394 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include "Platform.h"
+#include "PieceDef.h"
+#include "BoardState.h"
+#include "StandardSet.h"
+
+// Rules state of a chess game: piece definitions, board, side to move and move generation.
+// Has no dependency on the console so it can be driven headlessly (see Perft.h).
+// The move generation is written once as templates over Std: with the standard piece set the
+// pieces are resolved at compile time (StandardSet.h), with any other set through the PieceDef virtuals.
+class ChessRules {
+public:
+	const PieceDef* pieceDefs[16];	// Shared, read-only piece definitions indexed by id
+	byte pieceIds[16];	// Ids of the defined pieces
+	int nPieceIds;
+	BoardState board;
+	std::vector<MoveRecord> history;	// Undo stack, one record per move made
+
+	byte currTeam;
+
+	bool verifyKeys;	// Debug mode: check the incremental position key after every change
+	bool verifyMoves;	// Debug mode: check generateLegalMoves against playing every move
+	bool fastLegal;		// All pieces describe their attacks, so legality needs no trial moves
+	bool standardSet;	// The pieces are the standard set, handled by StandardSet.h
+
+	UINT64 attackedCrits;	// Critical pieces under attack, set by computeChecks
+	UINT64 legalMoves[64];	// Squares the piece on each square can move to, set by calculateLegalMoves
+	MoveList legalMoveList;	// The same moves as a list
+
+	ChessRules() : pieceDefs{ }, pieceIds{ }, nPieceIds(0), currTeam(1), verifyKeys(false), verifyMoves(false), fastLegal(false), standardSet(false),
+		attackedCrits(0), legalMoves{ } {
+		history.reserve(256);
+	};
+
+	ChessRules(std::vector<PieceDef*> pieces) : pieceDefs{ }, pieceIds{ }, nPieceIds(0), currTeam(1), verifyKeys(false), verifyMoves(false), fastLegal(false), standardSet(false),
+		attackedCrits(0), legalMoves{ } {
+		history.reserve(256);
+		setPieces(pieces);
+	};
+
+	// Register the piece definitions, indexed by their id.
+	void setPieces(std::vector<PieceDef*> pieces) {
+		for (size_t i = 0; i < pieces.size(); i++) {
+			pieceDefs[pieces[i]->id] = pieces[i];
+		}
+
+		nPieceIds = 0;
+		fastLegal = true;
+		for (int i = 1; i < 16; i++) {
+			if (pieceDefs[i] == NULL) continue;
+
+			pieceIds[nPieceIds++] = i;
+			fastLegal &= pieceDefs[i]->describesAttacks();
+		}
+
+		standardSet = nPieceIds == 6;
+		for (int i = 0; i < nPieceIds; i++) {
+			standardSet &= pieceDefs[pieceIds[i]]->standardId == pieceIds[i];
+		}
+	}
+
+	// 64-bit key of the position: the board's Zobrist hash and the side to move.
+	UINT64 positionKey() const {
+		return board.hash ^ (currTeam ? Zobrist.side : 0);
+	}
+
+	// Compare the incremental hash against a full recompute (in verifyKeys mode).
+	void checkKey() const {
+		if (verifyKeys && board.hash != board.computeHash())
+			throw std::runtime_error("Position key out of sync with board");
+	}
+
+	// True if the piece at pos is attacked by an enemy piece. Asks each enemy piece type
+	// for its attackers of pos rather than testing every enemy piece against pos.
+	bool isAttacked(IVec2 pos) {
+		return standardSet ? isAttackedT<true>(pos) : isAttackedT<false>(pos);
+	}
+
+	template <bool Std>
+	bool isAttackedT(IVec2 pos) {
+		Piece tgt = board.getPiece(pos);
+
+		if (tgt.id == 0) return false;
+		if (Std) return StandardSet::isAttacked(POS_TO_INDEX(pos), !tgt.team, board);
+
+		for (int i = 0; i < nPieceIds; i++) {
+			byte id = pieceIds[i];
+
+			if (board.pieces(id, !tgt.team) && pieceDefs[id]->attackers(pos, !tgt.team, board))
+				return true;
+		}
+		return false;
+	}
+
+	// Squares holding the critical pieces of a team.
+	UINT64 criticalPieces(bool team) const {
+		UINT64 crits = 0;
+
+		for (int i = 1; i < 16; i++) {
+			if (pieceDefs[i] != NULL && pieceDefs[i]->critical) crits |= board.pieces(i, team);
+		}
+		return crits;
+	}
+
+	// Make a move (without updating the rendered chess board).
+	// The changed squares are recorded on the undo stack.
+	bool makeMove(IVec2 start, IVec2 end) {
+		return standardSet ? makeMoveT<true>(start, end) : makeMoveT<false>(start, end);
+	}
+
+	template <bool Std>
+	bool makeMoveT(IVec2 start, IVec2 end) {
+		history.push_back(MoveRecord());
+		board.journal = &history.back();
+		board.journal->count = 0;
+
+		// Temporary flags only last one move
+		UINT64 temps = board.spTempBB;
+		while (temps) {
+			int i = popLsb(temps);
+			board.set(i, board[i] & ~PIECE_SPTEMP);
+		}
+
+		bool promote = Std ? StandardSet::makeMove(POS_TO_INDEX(start), POS_TO_INDEX(end), board) :
+			pieceDefs[board[start] & PIECE_ID]->makeMove(start, end, board);
+		board.journal = NULL;
+		currTeam ^= 1;
+		checkKey();
+
+		return promote;
+	}
+
+	// Undo the last move (without updating the rendered chess board).
+	void undoMove() {
+		if (history.empty()) return;
+
+		const MoveRecord& rec = history.back();
+		for (int i = rec.count - 1; i >= 0; i--) {
+			board.set(rec.pos[i], rec.old[i]);
+		}
+		history.pop_back();
+
+		currTeam ^= 1;
+		checkKey();
+	}
+
+	// Forget all recorded moves, ex. after setting up a new position.
+	void clearHistory() {
+		history.clear();
+	}
+
+	// Replace the piece at pos by a piece of the given id, keeping its team.
+	// The change is recorded as part of the last move, so undoing it restores the promoting piece.
+	void promote(IVec2 pos, byte id) {
+		if (!history.empty()) board.journal = &history.back();
+
+		board.set(pos, (board[pos] & PIECE_TEAM) | id);
+		board.journal = NULL;
+		checkKey();
+	}
+
+	// True if the piece with the given id may be chosen when promoting the piece at pos.
+	bool canPromoteTo(IVec2 pos, byte id) const {
+		return pieceDefs[id] != NULL && board.getPiece(pos).id != id && !pieceDefs[id]->critical;
+	}
+
+	// Return true if any critical pieces are under attack
+	bool inCheck(bool team) {
+		return standardSet ? inCheckT<true>(team) : inCheckT<false>(team);
+	}
+
+	template <bool Std>
+	bool inCheckT(bool team) {
+		UINT64 crits = Std ? board.pieces(StdKing, team) : criticalPieces(team);
+
+		while (crits) {
+			int i = popLsb(crits);
+			if (isAttackedT<Std>(IVec2(i & 7, i >> 3))) return true;
+		}
+
+		return false;
+	}
+
+	int computeChecks(bool team) {
+		attackedCrits = 0;
+		UINT64 crits = criticalPieces(team);
+
+		while (crits) {
+			int i = popLsb(crits);
+			if (isAttacked(IVec2(i & 7, i >> 3))) attackedCrits |= SQUARE_BIT(i);
+		}
+
+		return popcount(attackedCrits);
+	}
+
+	// Add the pseudolegal moves of a team to the list, from each piece's generateMoves.
+	void generatePseudoMoves(bool team, MoveList& moves) {
+		if (standardSet) generatePseudoMovesT<true>(team, moves);
+		else generatePseudoMovesT<false>(team, moves);
+	}
+
+	template <bool Std>
+	void generatePseudoMovesT(bool team, MoveList& moves) {
+		UINT64 own = board.teamBB[team];
+
+		while (own) {
+			int k = popLsb(own);
+
+			if (Std) StandardSet::generateMoves(k, board, moves);
+			else pieceDefs[board[k] & PIECE_ID]->generateMoves(IVec2(k & 7, k >> 3), board, moves);
+		}
+	}
+
+	// Squares attacked by a team with the given occupancy (requires fastLegal).
+	template <bool Std>
+	UINT64 attackMap(bool team, UINT64 occ) const {
+		UINT64 res = 0;
+		UINT64 pcs = board.teamBB[team];
+
+		while (pcs) {
+			int i = popLsb(pcs);
+			byte id = board[i] & PIECE_ID;
+			res |= Std ? StandardSet::attacks(id, i, team, occ) : pieceDefs[id]->attacks(i, team, occ);
+		}
+		return res;
+	}
+
+	// Find the enemy pieces attacking the critical piece at k and the own pieces pinned to it (requires fastLegal).
+	// evasion is narrowed to the squares capturing or blocking every checker, and pinned pieces
+	// get the squares of their pin ray (up to and including the pinner) in pinRay.
+	template <bool Std>
+	void findChecksAndPins(bool team, int k, UINT64& evasion, UINT64& pinned, UINT64* pinRay) const {
+		if (Std) return StandardSet::findChecksAndPins(team, k, board, evasion, pinned, pinRay);
+
+		IVec2 kPos = IVec2(k & 7, k >> 3);
+		IVec2 rays[32];
+
+		for (int p = 0; p < nPieceIds; p++) {
+			byte id = pieceIds[p];
+			if (!board.pieces(id, !team)) continue;
+
+			int nRays = pieceDefs[id]->slideRays(rays);
+
+			// Steps and leaps do not depend on the occupancy: the checker must be captured
+			if (nRays == 0) {
+				UINT64 checkers = pieceDefs[id]->attackers(kPos, !team, board);
+				while (checkers) evasion &= SQUARE_BIT(popLsb(checkers));
+				continue;
+			}
+
+			// Walk back along each ray from the critical piece to the first enemy behind at most one own piece
+			for (int r = 0; r < nRays; r++) {
+				UINT64 path = 0;
+				int blocker = -1;
+
+				for (IVec2 v = kPos - rays[r]; v.in88Square(); v -= rays[r]) {
+					int i = POS_TO_INDEX(v);
+					path |= SQUARE_BIT(i);
+					if (board[i] == 0) continue;
+
+					bool own = ((board[i] & PIECE_TEAM) != 0) == team;
+					if (own && blocker < 0) {
+						blocker = i;
+						continue;
+					}
+					if (!own && (board[i] & PIECE_ID) == id) {
+						if (blocker < 0) evasion &= path;
+						else {
+							pinRay[blocker] = (pinned & SQUARE_BIT(blocker)) ? pinRay[blocker] & path : path;
+							pinned |= SQUARE_BIT(blocker);
+						}
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	// True if playing the move leaves no critical piece of the team attacked.
+	template <bool Std>
+	bool legalByTrial(bool team, Move m) {
+		makeMoveT<Std>(m.startPos(), m.endPos());
+		bool legal = !inCheckT<Std>(team);
+		undoMove();
+
+		return legal;
+	}
+
+	// Fill the list with the legal moves of a team, by playing every pseudolegal move.
+	int generateLegalMovesByTrial(bool team, MoveList& legal) {
+		return standardSet ? generateLegalMovesByTrialT<true>(team, legal) : generateLegalMovesByTrialT<false>(team, legal);
+	}
+
+	template <bool Std>
+	int generateLegalMovesByTrialT(bool team, MoveList& legal) {
+		MoveList moves;
+		generatePseudoMovesT<Std>(team, moves);
+
+		legal.clear();
+		for (int i = 0; i < moves.size; i++) {
+			if (legalByTrial<Std>(team, moves[i])) legal.add(moves[i]);
+		}
+
+		return legal.size;
+	}
+
+	// Fill the list with the legal moves of a team and return their count.
+	// Pseudolegal moves are kept if they do not leave a critical piece attacked. With a single critical
+	// piece whose attackers are all described (fastLegal), checkers and pins are found once and the
+	// moves are filtered directly: critical piece steps against the enemy attack map, other pieces
+	// against the check evasion squares and their pin ray. Moves changing more than their start and end
+	// squares (en passant, castling) and other positions are still decided by playing the move.
+	int generateLegalMoves(bool team, MoveList& legal) {
+		return standardSet ? generateLegalMovesT<true>(team, legal) : generateLegalMovesT<false>(team, legal);
+	}
+
+	template <bool Std>
+	int generateLegalMovesT(bool team, MoveList& legal) {
+		UINT64 crits = Std ? board.pieces(StdKing, team) : criticalPieces(team);
+		if (!(Std || fastLegal) || popcount(crits) > 1) return generateLegalMovesByTrialT<Std>(team, legal);
+
+		MoveList moves;
+		generatePseudoMovesT<Std>(team, moves);
+		legal.clear();
+
+		int k = crits ? lsbIndex(crits) : -1;
+		UINT64 danger = 0, evasion = ~(UINT64)0, pinned = 0;
+		UINT64 pinRay[64];
+
+		if (k >= 0) {
+			danger = attackMap<Std>(!team, board.occupied() & ~SQUARE_BIT(k));
+			findChecksAndPins<Std>(team, k, evasion, pinned, pinRay);
+		}
+
+		for (int i = 0; i < moves.size; i++) {
+			const Move& m = moves[i];
+			UINT64 end = SQUARE_BIT(m.end);
+			bool ok;
+
+			if (k < 0) ok = true;
+			else if (Std ? !StandardSet::isPlainMove(m, board) : !pieceDefs[board[m.start] & PIECE_ID]->isPlainMove(m.startPos(), m.endPos(), board))
+				ok = legalByTrial<Std>(team, m);
+			else if (m.start == k) ok = !(danger & end);
+			else ok = (evasion & end) && (!(pinned & SQUARE_BIT(m.start)) || (pinRay[m.start] & end));
+
+			if (ok) legal.add(m);
+		}
+
+		if (verifyMoves) checkLegalMoves(team, legal);
+		return legal.size;
+	}
+
+	// Compare a legal move list with the one found by playing every move (in verifyMoves mode).
+	void checkLegalMoves(bool team, const MoveList& legal) {
+		MoveList trial;
+		generateLegalMovesByTrial(team, trial);
+
+		bool same = trial.size == legal.size;
+		for (int i = 0; same && i < legal.size; i++) {
+			same = legal[i].start == trial[i].start && legal[i].end == trial[i].end;
+		}
+		if (!same) throw std::runtime_error("Legal move generator disagrees with playing the moves");
+	}
+
+	int calculateLegalMoves(bool team) {
+		generateLegalMoves(team, legalMoveList);
+
+		for (int k = 0; k < 64; k++) legalMoves[k] = 0;
+		for (int i = 0; i < legalMoveList.size; i++) {
+			legalMoves[legalMoveList[i].start] |= SQUARE_BIT(legalMoveList[i].end);
+		}
+
+		return legalMoveCount();
+	}
+
+	// Number of legal moves found by calculateLegalMoves
+	int legalMoveCount() const {
+		int cnt = 0;
+		for (int k = 0; k < 64; k++) cnt += popcount(legalMoves[k]);
+		return cnt;
+	}
+
+	// Set legalMoves to the given target masks and rebuild legalMoveList from them.
+	void setLegalMoves(const UINT64* targets) {
+		legalMoveList.clear();
+		for (int k = 0; k < 64; k++) {
+			legalMoves[k] = targets[k];
+			legalMoveList.addTargets(k, targets[k]);
+		}
+	}
+};
@@ -1,50 +1,61 @@
-#include <Windows.h>
-#include <vector>
-#include "ChessGame.h"
-#include "UnitMovePiece.h"
-#include "SpriteDefs.h"
-#include "Pawn.h"
-#include "King.h"
+#include <cstring>
+#include <cstdio>
+#include "Platform.h"
+#include "StandardPieces.h"
+#include "Perft.h"
+#include "Engine.h"
+#include "Render.h"
+#include "UiBench.h"
 
-int main() {
-	// Pawn definition
-	Pawn pawn = Pawn(1, PawnSprite);
-	UnitMovePiece bishop = UnitMovePiece(2, false, false, BishopSprite);
-	bishop.generateMoveset(std::vector<IVec2> {IVec2(1, 1)}, Rotate90, true);
+int main(int argc, char* argv[]) {
+	// Headless modes
+	if (argc > 1 && strcmp(argv[1], "perft") == 0) return runPerft(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "search") == 0) return runSearch(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "render") == 0) return runRender(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "replay") == 0) return runReplay(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "uibench") == 0) return runUiBench(argc - 2, argv + 2);
 
-	UnitMovePiece knight = UnitMovePiece(3, false, true, KnightSprite);
-	knight.generateMoveset(std::vector<IVec2> {IVec2(2, 1)}, Rotate90 | FlipY, false);
+#ifdef _WIN32
+	// Standard piece definitions and initial chess position
+	StandardPieces set;
+	BoardState board = StandardPieces::startingBoard();
 
-	UnitMovePiece rook = UnitMovePiece(4, false, false, RookSprite);
-	rook.generateMoveset(std::vector<IVec2> {IVec2(1, 0)}, Rotate90, true);
+	// Create ChessGame object based on pieces and board
+	ChessGame game(set.pieces(), board);
 
-	UnitMovePiece queen = UnitMovePiece(5, false, false, QueenSprite);
-	queen.generateMoveset(std::vector<IVec2> {IVec2(1, 0)}, Rotate45, true);
+	// Output options: --vt draws through ANSI escape sequences (one write per frame), --fps <n> limits the redraws (0 for no limit)
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--vt") == 0) game.useVirtualTerminal();
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) game.setFrameRate((std::max)(0, atoi(argv[i + 1])));
+	}
 
-	King king = King(6, 4, KingSprite);
+	// Input options: --record <file> saves the key and mouse events, --replay <file> plays them back at the recorded speed
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0 && !game.recordInput(argv[i + 1])) printf("cannot create %s\n", argv[i + 1]);
+		else if (strcmp(argv[i], "--replay") == 0 && !game.replayInput(argv[i + 1], true)) printf("cannot read %s\n", argv[i + 1]);
+	}
 
-	// Create vector of PieceDef pointers
-	std::vector<PieceDef*> pieces {
-		&pawn,
-		&bishop,
-		&knight,
-		&rook,
-		&queen,
-		&king
-	};
-	// Initialize board state with initital chess position
-	BoardState board = BoardState(new byte[64] {
-		0x04, 0x03, 0x02, 0x05, 0x06, 0x02, 0x03, 0x04,
-		0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
-		0x14, 0x13, 0x12, 0x15, 0x16, 0x12, 0x13, 0x14
-	});
+	// Engine options: --engine <white|black|both> [--movetime <ms>] [--depth <n>] [--nodes <n>] [--threads <n>] [--hash <MB>]
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--engine") == 0) {
+			game.enginePlays[1] = strcmp(argv[i + 1], "black") != 0;
+			game.enginePlays[0] = strcmp(argv[i + 1], "white") != 0;
+		}
+		else if (strcmp(argv[i], "--movetime") == 0) game.engine.limits.timeMs = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--depth") == 0) game.engine.limits.depth = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--nodes") == 0) game.engine.limits.nodes = strtoull(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "--threads") == 0) game.engine.threads = (std::max)(1, atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--hash") == 0) game.engine.hashMb = strtoull(argv[i + 1], NULL, 10);
+	}
 
-	// Create ChessGame object based on pieces and board, and start its main loop
-	ChessGame game = ChessGame(pieces, board);
+	// Start its main loop
 	game.mainloop();
-}
\ No newline at end of file
+#else
+	printf("usage: %s perft <depth> [--divide] [--verify] [FEN]\n", argv[0]);
+	printf("       %s search [--depth <n>] [--movetime <ms>] [--nodes <n>] [--threads <n>] [--hash <MB>] [--scaling] [FEN]\n", argv[0]);
+	printf("       %s render [--out <file.ppm|file.png>] [--scale <n>] [--select <square>] [--hover <square>] [FEN]\n", argv[0]);
+	printf("       %s replay <file> [--realtime] [--fps <n>] [--out <file.ppm|file.png>] [--scale <n>]\n", argv[0]);
+	printf("       %s uibench [--iterations <n>] [--output ansi|framebuffer] [--json | --csv]\n", argv[0]);
+	return 1;
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Windows.h>
+#include "FrameOutput.h"
+
+// Output through the Win32 console API: the cell colors are console attributes,
+// and the colormap is applied to the console palette by GameWindow::applyColormap.
+// Moves the cursor only between runs and writes equally colored cells with one call.
+class ConsoleOutput : public FrameOutput {
+private:
+	HANDLE hConsoleOut;
+	int curX;	// Cursor position after the last run, -1 if unknown
+	int curY;
+	int curColor;	// Attribute in effect, -1 if unknown
+
+public:
+	ConsoleOutput(HANDLE hConsoleOut) : hConsoleOut(hConsoleOut), curX(-1), curY(-1), curColor(-1) {};
+
+	void writeRun(int x, int y, const byte* cells, int n) override {
+		static const char spaces[] = "                                                                ";
+		DWORD written;
+
+		if (x != curX || y != curY) {
+			COORD c;
+			c.X = x;
+			c.Y = y;
+			SetConsoleCursorPosition(hConsoleOut, c);
+		}
+
+		for (int i = 0; i < n;) {
+			int j = i + 1;
+			while (j < n && j - i < (int)sizeof(spaces) - 1 && cells[j] == cells[i]) j++;
+
+			if (cells[i] != curColor) {
+				SetConsoleTextAttribute(hConsoleOut, cells[i]);
+				curColor = cells[i];
+			}
+			WriteConsoleA(hConsoleOut, spaces, j - i, &written, NULL);
+			i = j;
+		}
+		curX = x + n;
+		curY = y;
+	}
+};
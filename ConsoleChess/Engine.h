@@ -0,0 +1,231 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Platform.h"
+#include "ChessRules.h"
+#include "Search.h"
+#include "StandardPieces.h"
+#include "Fen.h"
+
+// Computer player: runs a Search on a worker thread and hands its progress and result
+// back to the thread polling it, so the game loop never blocks on the search.
+// With several threads the worker starts Lazy SMP helpers sharing its transposition table.
+class Engine {
+private:
+	std::thread worker;
+	SearchShared shared;
+	std::atomic<bool> finished;
+
+	TranspositionTable tt;
+	size_t ttMb;	// Size the table was allocated for
+
+	std::mutex infoMutex;
+	SearchInfo info;	// Latest progress, guarded by infoMutex
+	bool infoChanged;
+	SearchInfo result;	// Written by the worker before finished is set
+
+public:
+	SearchLimits limits;
+	int threads;	// Search threads, including the worker
+	size_t hashMb;	// Transposition table size, allocated on the next start
+
+	Engine() : finished(false), ttMb(0), infoChanged(false), threads(1), hashMb(16) {
+		shared.tt = &tt;
+	};
+
+	~Engine() { stop(); }
+
+	Engine(const Engine&) = delete;
+	Engine& operator=(const Engine&) = delete;
+
+	// Start searching the position of the rules, which are copied. Stops any running search first.
+	void start(const ChessRules& rules) {
+		stop();
+		finished = false;
+		infoChanged = false;
+
+		if (ttMb != hashMb) {
+			tt.resize(hashMb);
+			ttMb = hashMb;
+		}
+		tt.newSearch();
+		shared.nodes = 0;
+
+		worker = std::thread([this, rules]() {
+			std::vector<std::thread> helpers;
+			for (int i = 1; i < threads; i++) {
+				helpers.push_back(std::thread([this, rules, i]() {
+					Search helper = Search(rules, &shared, i);
+					helper.run(limits);
+				}));
+			}
+
+			Search search = Search(rules, &shared);
+			search.onInfo = [this](const SearchInfo& i) {
+				std::lock_guard<std::mutex> lock(infoMutex);
+				info = i;
+				infoChanged = true;
+			};
+			result = search.run(limits);
+
+			// The helpers run until the main search is done
+			shared.stop = true;
+			for (size_t i = 0; i < helpers.size(); i++) helpers[i].join();
+			finished = true;
+		});
+	}
+
+	// Forget all stored positions. Call while not thinking.
+	void clearHash() {
+		tt.clear();
+	}
+
+	// Abort the running search, if any, and discard its result.
+	void stop() {
+		if (!worker.joinable()) return;
+
+		shared.stop = true;
+		worker.join();
+		shared.stop = false;
+		finished = false;
+	}
+
+	// True while a search is running or its result has not been collected.
+	bool thinking() const {
+		return worker.joinable();
+	}
+
+	// Get the latest progress if it changed since the last call.
+	bool pollInfo(SearchInfo& out) {
+		std::lock_guard<std::mutex> lock(infoMutex);
+		if (!infoChanged) return false;
+
+		out = info;
+		infoChanged = false;
+		return true;
+	}
+
+	// Collect the result of a finished search. Return false if the search is still running or none was started.
+	bool poll(SearchInfo& out) {
+		if (!worker.joinable() || !finished) return false;
+
+		worker.join();
+		shared.stop = false;
+		finished = false;
+		out = result;
+		return true;
+	}
+};
+
+// Short form of a count for the side panel, at most 4 characters up to 10 billion (ex. 950, 34K, 2.6M)
+std::string shortCount(double n) {
+	char buf[16];
+
+	if (n < 1e4) snprintf(buf, sizeof(buf), "%.0f", n);
+	else if (n < 999.5e3) snprintf(buf, sizeof(buf), "%.0fK", n / 1e3);
+	else if (n < 9.95e6) snprintf(buf, sizeof(buf), "%.1fM", n / 1e6);
+	else snprintf(buf, sizeof(buf), "%.0fM", n / 1e6);
+
+	return buf;
+}
+
+// Best line of a search in long algebraic notation
+std::string pvString(const SearchInfo& info) {
+	std::string s;
+
+	for (size_t i = 0; i < info.pv.size(); i++) {
+		const SearchMove& m = info.pv[i];
+		if (i > 0) s += ' ';
+		s += moveName(m.move.startPos(), m.move.endPos(), m.promoteId);
+	}
+	return s;
+}
+
+// Run the engine on a position until it is done, polling like the game loop does.
+// Each completed iteration is printed if verbose; the last one is reported before the search finishes.
+SearchInfo searchToEnd(Engine& engine, const ChessRules& rules, bool verbose) {
+	SearchInfo info, iter;
+	bool done = false;
+
+	engine.start(rules);
+	while (!done) {
+		done = engine.poll(info);
+
+		if (engine.pollInfo(iter) && verbose) {
+			printf("depth %d score %d nodes %llu nps %.0f pv %s\n", iter.depth, iter.score,
+				(unsigned long long)iter.nodes, iter.nps(), pvString(iter).c_str());
+		}
+		if (!done) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return info;
+}
+
+// Entry point of the "search" command line mode:
+//   search [--depth <n>] [--movetime <ms>] [--nodes <n>] [--threads <n>] [--hash <MB>] [--scaling] [FEN]
+// Searches the position with the standard piece set on the engine's worker thread(s),
+// printing each completed iteration and the best move. With --scaling the position is searched
+// to a fixed depth (8 by default) with 1, 2, 4... up to --threads threads, and the speed and
+// time to depth of each run are compared.
+int runSearch(int argc, char* argv[]) {
+	Engine engine;
+	bool scaling = false;
+	bool depthSet = false;
+	std::string fen;
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) { engine.limits.depth = atoi(argv[++i]); depthSet = true; }
+		else if (strcmp(argv[i], "--movetime") == 0 && i + 1 < argc) engine.limits.timeMs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) engine.limits.nodes = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) engine.threads = (std::max)(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) engine.hashMb = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--scaling") == 0) scaling = true;
+		else {
+			if (!fen.empty()) fen += ' ';
+			fen += argv[i];
+		}
+	}
+
+	StandardPieces set;
+	ChessRules rules = ChessRules(set.pieces());
+
+	if (!loadFen(fen.empty() ? FEN_START : fen.c_str(), rules)) {
+		printf("invalid FEN: %s\n", fen.c_str());
+		return 1;
+	}
+
+	if (scaling) {
+		int maxThreads = engine.threads;
+		double baseSecs = 0;
+
+		if (!depthSet) engine.limits.depth = 8;
+		engine.limits.timeMs = 0;
+		engine.limits.nodes = 0;
+		printf("Threads  Depth  Time (s)  Nodes       NPS         Speedup\n");
+
+		for (int t = 1; t <= maxThreads; t *= 2) {
+			engine.threads = t;
+			engine.clearHash();
+			SearchInfo info = searchToEnd(engine, rules, false);
+
+			if (t == 1) baseSecs = info.secs;
+			printf("%-8d %-6d %-9.3f %-11llu %-11.0f %.2f\n", t, info.depth, info.secs,
+				(unsigned long long)info.nodes, info.nps(), info.secs > 0 ? baseSecs / info.secs : 0.0);
+		}
+		return 0;
+	}
+
+	SearchInfo info = searchToEnd(engine, rules, true);
+
+	printf("Nodes: %llu\n", (unsigned long long)info.nodes);
+	printf("Time: %.3f s\n", info.secs);
+	printf("NPS: %.0f\n", info.nps());
+	printf("Best: %s\n", info.pv.empty() ? "(none)" :
+		moveName(info.pv[0].move.startPos(), info.pv[0].move.endPos(), info.pv[0].promoteId).c_str());
+	return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cctype>
+#include <string>
+#include "Platform.h"
+#include "BoardState.h"
+#include "ChessRules.h"
+
+// Piece letters indexed by piece id, matching the standard piece set.
+// Lowercase is black (team 0), uppercase is white (team 1).
+static const char FenPieces[] = ".pbnrqk";
+
+// Id of the piece with the given (lowercase) FEN letter
+#define FEN_ID(c) ((byte)(strchr(FenPieces, c) - FenPieces))
+
+// FEN of the initial chess position
+#define FEN_START "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+// Name of a board square in algebraic notation. Row 0 of the board is rank 8.
+std::string squareName(IVec2 pos) {
+	return std::string{ (char)('a' + pos.x), (char)('8' - pos.y) };
+}
+
+// Name of a move in long algebraic notation (ex. e2e4, e7e8q).
+std::string moveName(IVec2 start, IVec2 end, byte promoteId = 0) {
+	std::string name = squareName(start) + squareName(end);
+	if (promoteId != 0 && promoteId < sizeof(FenPieces) - 1) name += FenPieces[promoteId];
+
+	return name;
+}
+
+// Load a position in Forsyth-Edwards Notation into the rules' board and side to move.
+// The game stores no castling rights, so missing rights are encoded as moved king/rook flags,
+// and the en passant target marks the pawn that just moved with PIECE_SPTEMP.
+// Return false if the FEN could not be parsed; the rules are left untouched in that case.
+bool loadFen(const char* fen, ChessRules& rules) {
+	BoardState b = BoardState();
+	int x = 0, y = 0;
+	const char* c = fen;
+
+	// Piece placement
+	for (; *c && *c != ' '; c++) {
+		if (*c == '/') {
+			if (x != 8) return false;
+			x = 0; y++;
+		}
+		else if (isdigit(*c)) x += *c - '0';
+		else {
+			const char* f = strchr(FenPieces, tolower(*c));
+			if (f == NULL || f == FenPieces || x > 7 || y > 7) return false;
+
+			byte team = isupper(*c) ? PIECE_TEAM : 0;
+			b.set(IVec2(x, y), team | (byte)(f - FenPieces));
+			x++;
+		}
+	}
+	if (x != 8 || y != 7) return false;
+
+	// Side to move
+	while (*c == ' ') c++;
+	byte team = 1;
+	if (*c == 'b') team = 0;
+	else if (*c != 'w') return false;
+	c++;
+
+	// Castling rights
+	while (*c == ' ') c++;
+	const char* castling = "KQkq";
+	bool rights[4] = { };
+	for (; *c && *c != ' '; c++) {
+		const char* f = strchr(castling, *c);
+		if (f != NULL) rights[f - castling] = true;
+	}
+
+	// Kings and rooks keep their moved flag clear only where a castling right needs them,
+	// and pawns off their starting row can no longer double step
+	for (int i = 0; i < 64; i++) {
+		Piece p = b.getPiece(i);
+		int file = i & 7, home = p.team ? 7 : 0;
+		bool kingSide = rights[p.team ? 0 : 2], queenSide = rights[p.team ? 1 : 3];
+		bool unmoved = true;
+
+		if (p.id == FEN_ID('k')) unmoved = (i >> 3) == home && file == 4 && (kingSide || queenSide);
+		if (p.id == FEN_ID('r')) unmoved = (i >> 3) == home && ((file == 7 && kingSide) || (file == 0 && queenSide));
+		if (p.id == FEN_ID('p')) unmoved = (i >> 3) == (p.team ? 6 : 1);
+
+		if (!unmoved) b.set(i, b[i] | PIECE_MOVED);
+	}
+
+	// En passant target
+	while (*c == ' ') c++;
+	if (*c >= 'a' && *c <= 'h' && (c[1] == '3' || c[1] == '6')) {
+		IVec2 pawn = IVec2(*c - 'a', c[1] == '3' ? 4 : 3);
+		if (b.getPiece(pawn).id == FEN_ID('p')) b.set(pawn, b[pawn] | PIECE_SPTEMP);
+	}
+
+	rules.board = b;
+	rules.clearHistory();
+	rules.currTeam = team;
+	return true;
+}
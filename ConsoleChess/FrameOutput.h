@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include "Platform.h"
+
+// Destination of the cells GameWindow::invalidate found changed in a frame.
+// A cell is a console character cell drawn as a space; its byte is a console attribute,
+// with the colormap index of the background in the high nibble.
+class FrameOutput {
+public:
+	virtual ~FrameOutput() {};
+
+	// Use a 16-entry colormap. Return true if the cells already on screen
+	// must be written again to show the new colors.
+	virtual bool setColormap(const COLORREF* colormap) { return false; }
+
+	// Size of the window in cells, set by GameWindow::setup.
+	virtual void setSize(int width, int height) {};
+
+	virtual void beginFrame() {};
+
+	// Cells x to x + n - 1 of row y now hold the given bytes.
+	virtual void writeRun(int x, int y, const byte* cells, int n) = 0;
+
+	// Put the frame on screen.
+	virtual void endFrame() {};
+
+	// Unchanged cells a run may include instead of being split in two, because
+	// writing them again is cheaper than moving the cursor.
+	virtual int runGap() const { return 0; }
+};
+
+// Output for ANSI / VT terminals (Linux terminals, Windows consoles in virtual terminal mode).
+// The frame is built in one buffer and written at once: runs move the cursor only if they do not
+// continue the previous one, and 24-bit background colors are only sent when they change.
+// Without a file the frames are only built in memory, ex. to benchmark the render path.
+class AnsiOutput : public FrameOutput {
+private:
+	FILE* out;
+	std::string buf;
+	COLORREF colors[16];
+	bool clearScreen;	// The first frame starts by clearing the screen
+	int curX;	// Cursor position after the last run, -1 if unknown
+	int curY;
+	int curColor;	// Background color index in effect, -1 if unknown
+
+	void appendInt(int v) {
+		char digits[12];
+		int n = 0;
+
+		do { digits[n++] = '0' + v % 10; v /= 10; } while (v > 0);
+		while (n > 0) buf += digits[--n];
+	}
+
+	void moveTo(int x, int y) {
+		buf += "\x1b[";
+		appendInt(y + 1);
+		buf += ';';
+		appendInt(x + 1);
+		buf += 'H';
+	}
+
+	void setBackground(int index) {
+		COLORREF c = colors[index];
+
+		buf += "\x1b[48;2;";
+		appendInt(c & 0xFF);
+		buf += ';';
+		appendInt((c >> 8) & 0xFF);
+		buf += ';';
+		appendInt((c >> 16) & 0xFF);
+		buf += 'm';
+	}
+
+public:
+	size_t frameBytes;	// Size of the last frame written
+
+	AnsiOutput(FILE* out = stdout) : out(out), colors{ }, clearScreen(true), curX(-1), curY(-1), curColor(-1), frameBytes(0) {
+		buf.reserve(1 << 16);
+	}
+
+	bool setColormap(const COLORREF* colormap) override {
+		bool changed = memcmp(colors, colormap, sizeof(colors)) != 0;
+
+		memcpy(colors, colormap, sizeof(colors));
+		if (changed) curColor = -1;
+		return changed;
+	}
+
+	void beginFrame() override {
+		buf.clear();
+
+		if (clearScreen) {
+			buf += "\x1b[0m\x1b[2J\x1b[?25l";	// Reset the colors, clear and hide the cursor
+			clearScreen = false;
+			curX = curY = curColor = -1;
+		}
+	}
+
+	void writeRun(int x, int y, const byte* cells, int n) override {
+		if (x != curX || y != curY) moveTo(x, y);
+
+		for (int i = 0; i < n; i++) {
+			int c = (cells[i] >> 4) & 0xF;
+			if (c != curColor) {
+				setBackground(c);
+				curColor = c;
+			}
+			buf += ' ';
+		}
+		curX = x + n;
+		curY = y;
+	}
+
+	void endFrame() override {
+		frameBytes = buf.size();
+		if (buf.empty() || out == NULL) return;
+
+		fflush(out);
+		fwrite(buf.data(), 1, buf.size(), out);
+		fflush(out);
+	}
+
+	// A cursor move takes 6 to 8 bytes
+	int runGap() const override { return 4; }
+
+	// Restore the terminal's colors and cursor, ex. before exiting.
+	void restore() {
+		if (out == NULL) return;
+		fputs("\x1b[0m\x1b[?25h\n", out);
+		fflush(out);
+		clearScreen = true;
+	}
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "FrameOutput.h"
+
+// Output to an RGB image in memory, one pixel per cell, for rendering without a console:
+// benchmarks of the render path, golden images of the compositor, position images on a server.
+// It receives the same runs from GameWindow::invalidate as the console backends.
+class FramebufferOutput : public FrameOutput {
+private:
+	int w;
+	int h;
+	COLORREF colors[16];
+	std::vector<byte> cells;	// Cell bytes written so far, to recolor the image when the colormap changes
+	std::vector<byte> rgb;	// 3 bytes per pixel, rows from the top
+
+	void setPixel(int i, byte cell) {
+		COLORREF c = colors[(cell >> 4) & 0xF];
+
+		rgb[3 * i] = c & 0xFF;
+		rgb[3 * i + 1] = (c >> 8) & 0xFF;
+		rgb[3 * i + 2] = (c >> 16) & 0xFF;
+	}
+
+	// Rows of the image with each pixel repeated scale x scale times, each passed to put.
+	template <class F>
+	void scaledRows(int scale, F put) const {
+		std::vector<byte> line(3 * w * scale);
+
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				for (int s = 0; s < scale; s++) memcpy(&line[3 * (x * scale + s)], &rgb[3 * (y * w + x)], 3);
+			}
+			for (int s = 0; s < scale; s++) put(line.data(), (int)line.size());
+		}
+	}
+
+	static void putBE32(FILE* f, UINT64 v) {
+		byte b[4] = { (byte)(v >> 24), (byte)(v >> 16), (byte)(v >> 8), (byte)v };
+		fwrite(b, 1, 4, f);
+	}
+
+	static UINT64 crc32(UINT64 crc, const byte* data, size_t n) {
+		static UINT64 table[256];
+		if (table[1] == 0) {
+			for (int i = 0; i < 256; i++) {
+				UINT64 c = i;
+				for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+				table[i] = c;
+			}
+		}
+		for (size_t i = 0; i < n; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return crc;
+	}
+
+	static void writeChunk(FILE* f, const char* type, const std::vector<byte>& data) {
+		putBE32(f, data.size());
+		fwrite(type, 1, 4, f);
+		fwrite(data.data(), 1, data.size(), f);
+		UINT64 crc = crc32(0xFFFFFFFF, (const byte*)type, 4);
+		putBE32(f, crc32(crc, data.data(), data.size()) ^ 0xFFFFFFFF);
+	}
+
+public:
+	int frames;	// Frames written
+	int lastCells;	// Cells written by the last frame
+	int lastRuns;	// Runs of the last frame
+
+	FramebufferOutput() : w(0), h(0), colors{ }, frames(0), lastCells(0), lastRuns(0) {};
+
+	void setSize(int width, int height) override {
+		w = width;
+		h = height;
+		cells.assign(w * h, 0);
+		rgb.assign(3 * w * h, 0);
+		for (int i = 0; i < w * h; i++) setPixel(i, 0);
+	}
+
+	// The image keeps the cells, so it is recolored here instead of being written again
+	bool setColormap(const COLORREF* colormap) override {
+		memcpy(colors, colormap, sizeof(colors));
+		for (int i = 0; i < w * h; i++) setPixel(i, cells[i]);
+		return false;
+	}
+
+	void beginFrame() override {
+		lastCells = 0;
+		lastRuns = 0;
+	}
+
+	void writeRun(int x, int y, const byte* run, int n) override {
+		int i = y * w + x;
+
+		memcpy(&cells[i], run, n);
+		for (int k = 0; k < n; k++) setPixel(i + k, run[k]);
+		lastCells += n;
+		lastRuns++;
+	}
+
+	void endFrame() override {
+		frames++;
+	}
+
+	int width() const { return w; }
+	int height() const { return h; }
+
+	// RGB bytes of the image, row by row from the top
+	const byte* pixels() const { return rgb.data(); }
+
+	// Cell byte (console attribute) at x, y
+	byte cell(int x, int y) const { return cells[y * w + x]; }
+
+	// Save the image as a binary PPM, each cell scale x scale pixels. Returns false if the file cannot be written.
+	bool writePPM(const char* path, int scale = 1) const {
+		FILE* f;
+		if (fopen_s(&f, path, "wb") != 0) return false;
+
+		fprintf(f, "P6\n%d %d\n255\n", w * scale, h * scale);
+		scaledRows(scale, [f](const byte* row, int n) { fwrite(row, 1, n, f); });
+		return fclose(f) == 0;
+	}
+
+	// Save the image as a PNG, each cell scale x scale pixels. The pixel data is stored
+	// without compression (deflate stored blocks), which keeps the writer free of dependencies.
+	bool writePNG(const char* path, int scale = 1) const {
+		FILE* f;
+		if (fopen_s(&f, path, "wb") != 0) return false;
+
+		static const byte signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		fwrite(signature, 1, 8, f);
+
+		std::vector<byte> header(13, 0);
+		int iw = w * scale, ih = h * scale;
+		for (int i = 0; i < 4; i++) {
+			header[i] = (byte)(iw >> (24 - 8 * i));
+			header[4 + i] = (byte)(ih >> (24 - 8 * i));
+		}
+		header[8] = 8;	// Bit depth
+		header[9] = 2;	// RGB
+		writeChunk(f, "IHDR", header);
+
+		// Rows with filter type 0, wrapped in a zlib stream of stored blocks
+		std::vector<byte> raw;
+		scaledRows(scale, [&raw](const byte* row, int n) { raw.push_back(0); raw.insert(raw.end(), row, row + n); });
+
+		std::vector<byte> z = { 0x78, 0x01 };
+		for (size_t pos = 0; pos < raw.size(); pos += 65535) {
+			size_t n = (std::min)(raw.size() - pos, (size_t)65535);
+			z.push_back(pos + n == raw.size());	// Last block flag
+			z.push_back(n & 0xFF);
+			z.push_back(n >> 8);
+			z.push_back(~n & 0xFF);
+			z.push_back((~n >> 8) & 0xFF);
+			z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+		}
+		UINT64 a = 1, b = 0;	// Adler-32 of the uncompressed data
+		for (size_t i = 0; i < raw.size(); i++) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		UINT64 adler = b << 16 | a;
+		for (int i = 0; i < 4; i++) z.push_back((byte)(adler >> (24 - 8 * i)));
+
+		writeChunk(f, "IDAT", z);
+		writeChunk(f, "IEND", std::vector<byte>());
+		return fclose(f) == 0;
+	}
+};
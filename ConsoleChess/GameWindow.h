@@ -1,11 +1,19 @@
 #pragma once
 #define _WIN32_WINNT 0x0500
 
-#include <Windows.h>
+#include "Platform.h"
 #include "Byte88.h"
 #include "Layer.h"
 #include "PixelFont.h"
+#include "GlyphCache.h"
+#include "FrameOutput.h"
+#include "InputRecording.h"
+#ifdef _WIN32
+#include "ConsoleOutput.h"
+#endif
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <vector>
 
 // Typedefs for event handler delegate types
@@ -14,16 +22,41 @@ typedef std::function<void(MOUSE_EVENT_RECORD)> MOUSE_EVENT_PROC;
 typedef std::function<void(MENU_EVENT_RECORD)> MENU_EVENT_PROC;
 typedef std::function<void(FOCUS_EVENT_RECORD)> FOCUS_EVENT_PROC;
 typedef std::function<void(WINDOW_BUFFER_SIZE_RECORD)> BUFFER_EVENT_PROC;
+typedef std::function<void()> IDLE_PROC;
+typedef std::function<void()> DRAW_PROC;
 
 // Size of the event record buffer for GameWindow object
 #define SZ_RECORD_BUFFER 128
 
+// Where the time of one frame went, in microseconds, and how much it wrote
+struct FrameStats {
+	double drawUs;	// Drawing the layers, as reported by the caller of invalidate
+	double compositeUs;	// Collecting the dirty tiles and compositing them
+	double diffUs;	// Comparing them to the screen and collecting the changed runs
+	double outputUs;	// Sending the runs to the output
+	int tiles;	// Dirty window tiles
+	int cells;	// Cells sent
+	int runs;
+
+	FrameStats() : drawUs(0), compositeUs(0), diffUs(0), outputUs(0), tiles(0), cells(0), runs(0) {};
+};
+
+// Without Windows there is no console: the window only composites into its output
+// (ex. a FramebufferOutput), and input events are delivered by calling the handlers directly.
 class GameWindow {
 
 private:
+#ifdef _WIN32
+	struct HandleClose {
+		void operator()(HANDLE h) const { CloseHandle(h); }
+	};
+
 	HANDLE hConsoleIn;
 	HANDLE hConsoleOut;
+	std::unique_ptr<void, HandleClose> hWake;	// Set by wake to end the wait for input early, closed with the window
 	INPUT_RECORD inputRecords[SZ_RECORD_BUFFER];
+#endif
+	RecordedEvent replayRecords[SZ_RECORD_BUFFER];
 
 	COLORREF cmapDefault[16];
 
@@ -34,6 +67,25 @@ private:
 	Layer renderBuffer;	
 	Layer backBuffer;	
 
+	std::unique_ptr<FrameOutput> output;
+	std::unique_ptr<InputRecorder> recorder;	// Records the dispatched key and mouse events, if set
+	std::unique_ptr<InputReplay> replay;	// Replaces the console input until it is finished, if set
+	bool fullRepaint;	// Write every cell on the next invalidate, ex. after a colormap or output change
+
+	bool framePending;	// A frame was requested and not drawn yet
+	bool inputPending;	// Input was handled since the last frame
+	std::chrono::steady_clock::time_point lastFrame;
+	std::chrono::steady_clock::time_point inputSince;	// When the first input not shown yet was dispatched
+
+	// Changed cells x to x + n - 1 of row y, found by the diff of a frame
+	struct CellRun {
+		int x;
+		int y;
+		int n;
+	};
+	std::vector<CellRun> runs;	// Reserved by setup for the worst case, so frames do not allocate
+
+#ifdef _WIN32
 	void setConsoleBufferSize(int row, int col) {
 		// Use SetConsoleScreenBufferSize to set the screen buffer size
 		// to match the window size
@@ -64,6 +116,18 @@ private:
 		wcscpy_s(cfi.FaceName, fontFace);
 		return SetCurrentConsoleFontEx(hConsoleOut, FALSE, &cfi);
 	}
+#endif
+
+	// Account for an event whose handler started at t0: the input waits for the next frame if it requested one
+	void handled(std::chrono::steady_clock::time_point t0) {
+		dispatchUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+		dispatched++;
+
+		if (framePending && !inputPending) {
+			inputPending = true;
+			inputSince = t0;
+		}
+	}
 
 public:
 	KEY_EVENT_PROC onKeyEvent; 
@@ -71,6 +135,17 @@ public:
 	MENU_EVENT_PROC onMenuEvent; 
 	FOCUS_EVENT_PROC onFocusEvent;	
 	BUFFER_EVENT_PROC onBufferEvent; 
+	IDLE_PROC onIdle;	// Called every tick, after the input events (if any)
+	DRAW_PROC onDraw;	// Draws a requested frame, at most once per tick and frameInterval
+	double dispatchUs;	// Time the handler of the last key or mouse event took
+	size_t dispatched;	// Key and mouse events dispatched so far
+	size_t coalesced;	// Mouse moves dropped because a later move replaced them
+	double latencyUs;	// From the first input handled to the end of the frame showing it, for the last such frame
+	size_t inputFrames;	// Frames that showed input
+	FrameStats frameStats;	// Of the last invalidate
+	std::function<void(const FrameStats&)> onFrame;	// Called after each invalidate, if set
+	DWORD idleInterval;	// Longest time in ms a tick waits for input, INFINITE to block
+	DWORD frameInterval;	// Shortest time in ms between two frames, 0 for no limit
 	COLORREF colormap[16];	
 
 	byte textFill;
@@ -81,22 +156,39 @@ public:
 
 	std::vector<Layer> layers;
 
+	LayerArena arena;	// Holds the render and back buffers and the layers made by addLayer/makeLayer
+	GlyphCache glyphs;	// Text drawn by spriteText
 
-	GameWindow() : inputRecords{} {
-		
+
+	GameWindow() : fullRepaint(false), framePending(false), inputPending(false), dispatchUs(0), dispatched(0), coalesced(0),
+		latencyUs(0), inputFrames(0), frameInterval(0) {
+#ifdef _WIN32
 		hConsoleIn = GetStdHandle(STD_INPUT_HANDLE);
 		hConsoleOut = GetStdHandle(STD_OUTPUT_HANDLE);
+		hWake.reset(CreateEvent(NULL, FALSE, FALSE, NULL));
+		memset(inputRecords, 0, sizeof(inputRecords));
+		output.reset(new ConsoleOutput(hConsoleOut));
+#else
+		output.reset(new AnsiOutput());
+#endif
 		onKeyEvent = NULL;
 		onMouseEvent = NULL;
 		onMenuEvent = NULL;
 		onFocusEvent = NULL;
 		onBufferEvent = NULL;
+		onIdle = NULL;
+		onDraw = NULL;
+		idleInterval = INFINITE;
 
+#ifdef _WIN32
 		CONSOLE_SCREEN_BUFFER_INFOEX cBuffInfo = CONSOLE_SCREEN_BUFFER_INFOEX();
 		cBuffInfo.cbSize = sizeof(CONSOLE_SCREEN_BUFFER_INFOEX);
 		GetConsoleScreenBufferInfoEx(hConsoleOut, &cBuffInfo);
 
 		memcpy_s(cmapDefault, sizeof(cmapDefault), cBuffInfo.ColorTable, sizeof(cmapDefault));
+#else
+		memset(cmapDefault, 0, sizeof(cmapDefault));
+#endif
 		memcpy_s(colormap, sizeof(colormap), cmapDefault, sizeof(colormap));
 
 		ready = false;
@@ -107,7 +199,9 @@ public:
 	}
 
 	// Setup (initialize) the game window to the specified settings.
-	void setup(int width, int height, int fontWidth, int fontHeight) {	
+	// maxLayers window-sized layers are reserved in the arena next to the render and back buffers.
+	void setup(int width, int height, int fontWidth, int fontHeight, int maxLayers = 8) {	
+#ifdef _WIN32
 		// Set console mode to block select user input
 		SetConsoleMode(hConsoleIn, ENABLE_EXTENDED_FLAGS | ~ENABLE_QUICK_EDIT_MODE);
 		setFont(L"Courrier New", fontWidth, fontHeight);
@@ -118,49 +212,219 @@ public:
 		
 		// Set console to provided size
 		setConsoleBufferSize(height, width);
+#endif
 
 		// Init basic properties and buffers
 		this->width = width;
 		this->height = height;
-		renderBuffer = Layer(width, height, alphaColor, IVec2(0, 0));
-		backBuffer = Layer(width, height, alphaColor, IVec2(0, 0));
-		layers = std::vector<Layer>{ };
+		layers.clear();
+		renderBuffer = Layer();
+		backBuffer = Layer();
+		arena.reserve(static_cast<size_t>(width) * height * (2 + maxLayers) + 64 * (2 + maxLayers));
+
+		renderBuffer = Layer(arena, width, height, alphaColor, IVec2(0, 0));
+		backBuffer = Layer(arena, width, height, alphaColor, IVec2(0, 0));
+		layers.reserve(maxLayers);
+		runs.reserve(static_cast<size_t>(height) * (width / 2 + 1));
+		output->setSize(width, height);
 		ready = true;
 	}
 
+	// Make a layer carved from the window's arena, without adding it to the composited layers.
+	Layer makeLayer(int w, int h, byte val, IVec2 pos = IVec2(0, 0)) {
+		return Layer(arena, w, h, val, pos);
+	}
+
+	// Add a layer carved from the window's arena on top of the others, returning its index.
+	size_t addLayer(int w, int h, byte val, IVec2 pos = IVec2(0, 0)) {
+		layers.emplace_back(arena, w, h, val, pos);
+		return layers.size() - 1;
+	}
+
+	// Send an input event to its handler, recording it first if recording.
+	void dispatchKey(const KEY_EVENT_RECORD& evt) {
+		if (recorder) recorder->record(evt);
+
+		auto t0 = std::chrono::steady_clock::now();
+		if (onKeyEvent != NULL) onKeyEvent(evt);
+		handled(t0);
+	}
+
+	void dispatchMouse(const MOUSE_EVENT_RECORD& evt) {
+		if (recorder) recorder->record(evt);
+
+		auto t0 = std::chrono::steady_clock::now();
+		if (onMouseEvent != NULL) onMouseEvent(evt);
+		handled(t0);
+	}
+
+	// A mouse move without buttons held, which only matters until the next one arrives
+	static bool isPlainMove(const MOUSE_EVENT_RECORD& evt) {
+		return evt.dwEventFlags == MOUSE_MOVED && evt.dwButtonState == 0;
+	}
+
+	// Record a mouse move replaced by a later one, without handling it
+	void coalesce(const MOUSE_EVENT_RECORD& evt) {
+		if (recorder) recorder->record(evt);
+		coalesced++;
+	}
+
+	// Ask for a frame to be drawn (by onDraw) at the end of the tick, or once frameInterval has passed since the last.
+	// Requests made before then are drawn by the same frame.
+	void requestFrame() {
+		framePending = true;
+	}
+
+	// Draw the requested frame now, regardless of frameInterval. Returns false if none was requested.
+	bool drawFrame() {
+		if (!framePending) return false;
+
+		framePending = false;
+		if (onDraw != NULL) onDraw();
+		lastFrame = std::chrono::steady_clock::now();
+
+		if (inputPending) {
+			latencyUs = std::chrono::duration<double, std::micro>(lastFrame - inputSince).count();
+			inputFrames++;
+			inputPending = false;
+		}
+		return true;
+	}
+
+	// Time in ms until the requested frame may be drawn, INFINITE if none was requested
+	DWORD frameWait() const {
+		if (!framePending) return INFINITE;
+
+		auto due = lastFrame + std::chrono::milliseconds(frameInterval);
+		auto now = std::chrono::steady_clock::now();
+		if (due <= now) return 0;
+		return (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1;
+	}
+
+	// Record the dispatched key and mouse events to a file (see InputRecording.h).
+	bool startRecording(const char* path) {
+		recorder.reset(new InputRecorder());
+		if (recorder->open(path)) return true;
+
+		recorder.reset();
+		return false;
+	}
+
+	void stopRecording() {
+		recorder.reset();
+	}
+
+	// Take the input events from a recording instead of the console, at the recorded speed if realtime,
+	// else as fast as possible (a full record buffer per tick). Returns false if it cannot be loaded.
+	bool startReplay(const char* path, bool realtime) {
+		replay.reset(new InputReplay());
+		if (!replay->load(path)) {
+			replay.reset();
+			return false;
+		}
+		replay->rewind(realtime);
+		return true;
+	}
+
+	bool replaying() const {
+		return replay && !replay->finished();
+	}
+
+	// End the current (or next) wait for input of eventTick, ex. when a worker thread has a result for onIdle.
+	// Can be called from any thread.
+	void wake() {
+#ifdef _WIN32
+		SetEvent(hWake.get());
+#endif
+	}
+
+	// Handle the input that arrived, waiting for it at most idleInterval (or until a requested frame is due),
+	// then run onIdle and draw the requested frame if frameInterval allows. Consecutive plain mouse moves
+	// are coalesced to the latest, so a fast mouse costs one frame per tick instead of one per record.
 	void eventTick() {
-		DWORD nRecordsRead;
-		if (ReadConsoleInput(hConsoleIn, inputRecords, SZ_RECORD_BUFFER, &nRecordsRead)) {	// Go through the records read and dispatch them to the correct event handler
-			for (int i = 0; i < nRecordsRead; i++) {
-				INPUT_RECORD record = inputRecords[i];
-				switch (record.EventType) {
-					case KEY_EVENT: 
-						if (onKeyEvent != NULL) onKeyEvent(record.Event.KeyEvent); 
-						break;
-					case MOUSE_EVENT: 
-						if (onMouseEvent != NULL) onMouseEvent(record.Event.MouseEvent); 
-						break;
-					case MENU_EVENT: 
-						if (onMenuEvent != NULL) onMenuEvent(record.Event.MenuEvent); 
-						break;
-					case FOCUS_EVENT: 
-						if (onFocusEvent != NULL) onFocusEvent(record.Event.FocusEvent); 
-						break;
-					case WINDOW_BUFFER_SIZE_EVENT: 
-						if (onBufferEvent != NULL) onBufferEvent(record.Event.WindowBufferSizeEvent); 
-						break;
+		DWORD wait = (std::min)(idleInterval, frameWait());
+
+		if (replaying()) {
+			int n = 0;
+			if (replay->next(replayRecords[0], wait)) {
+				n = 1;
+				while (n < SZ_RECORD_BUFFER && replay->next(replayRecords[n], 0)) n++;
+			}
+			for (int i = 0; i < n; i++) {
+				const RecordedEvent& e = replayRecords[i];
+				if (e.type == RecordKey) dispatchKey(e.key);
+				else if (i + 1 < n && isPlainMove(e.mouse) && replayRecords[i + 1].type == RecordMouse && isPlainMove(replayRecords[i + 1].mouse)) coalesce(e.mouse);
+				else dispatchMouse(e.mouse);
+			}
+		}
+#ifdef _WIN32
+		else {
+			DWORD nRecordsRead;
+			// Wait for input at most idleInterval, so onIdle keeps running without input
+			HANDLE handles[2] = { hConsoleIn, hWake.get() };
+			if (WaitForMultipleObjects(2, handles, FALSE, wait) == WAIT_OBJECT_0 &&
+				ReadConsoleInput(hConsoleIn, inputRecords, SZ_RECORD_BUFFER, &nRecordsRead)) {	// Go through the records read and dispatch them to the correct event handler
+				for (int i = 0; i < nRecordsRead; i++) {
+					INPUT_RECORD record = inputRecords[i];
+					switch (record.EventType) {
+						case KEY_EVENT: 
+							dispatchKey(record.Event.KeyEvent); 
+							break;
+						case MOUSE_EVENT: 
+							if (i + 1 < nRecordsRead && isPlainMove(record.Event.MouseEvent) && inputRecords[i + 1].EventType == MOUSE_EVENT &&
+								isPlainMove(inputRecords[i + 1].Event.MouseEvent)) coalesce(record.Event.MouseEvent);
+							else dispatchMouse(record.Event.MouseEvent); 
+							break;
+						case MENU_EVENT: 
+							if (onMenuEvent != NULL) onMenuEvent(record.Event.MenuEvent); 
+							break;
+						case FOCUS_EVENT: 
+							if (onFocusEvent != NULL) onFocusEvent(record.Event.FocusEvent); 
+							break;
+						case WINDOW_BUFFER_SIZE_EVENT: 
+							if (onBufferEvent != NULL) onBufferEvent(record.Event.WindowBufferSizeEvent); 
+							break;
+					}
 				}
 			}
 		}
+#endif
+
+		if (onIdle != NULL) onIdle();
+		if (frameWait() == 0) drawFrame();
 	}
 
 	void applyColormap() {
+#ifdef _WIN32
 		CONSOLE_SCREEN_BUFFER_INFOEX cBuffInfo = CONSOLE_SCREEN_BUFFER_INFOEX();
 		cBuffInfo.cbSize = sizeof(CONSOLE_SCREEN_BUFFER_INFOEX);
 		GetConsoleScreenBufferInfoEx(hConsoleOut, &cBuffInfo);
 
 		memcpy_s(cBuffInfo.ColorTable, sizeof(cBuffInfo.ColorTable), colormap, sizeof(colormap));
 		SetConsoleScreenBufferInfoEx(hConsoleOut, &cBuffInfo);
+#endif
+
+		if (output->setColormap(colormap)) fullRepaint = true;
+	}
+
+	// Replace the output backend. The whole window is written to it on the next invalidate.
+	void setOutput(FrameOutput* out) {
+		output.reset(out);
+		output->setColormap(colormap);
+		if (ready) output->setSize(width, height);
+		fullRepaint = true;
+	}
+
+	// Switch to ANSI escape sequence output if the console supports virtual terminal processing.
+	bool useVirtualTerminal() {
+#ifdef _WIN32
+		DWORD mode = 0;
+		if (!GetConsoleMode(hConsoleOut, &mode) ||
+			!SetConsoleMode(hConsoleOut, mode | ENABLE_PROCESSING_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) return false;
+#endif
+
+		setOutput(new AnsiOutput());
+		return true;
 	}
 
 	void resetColormap() {
@@ -168,6 +432,7 @@ public:
 		applyColormap();
 	}
 
+#ifdef _WIN32
 	void setColor(int bg, int fg) {
 		SetConsoleTextAttribute(hConsoleOut, (bg & 0xf) << 4 | (fg & 0xf));
 	}
@@ -182,46 +447,142 @@ public:
 		c.Y = row;
 		SetConsoleCursorPosition(hConsoleOut, c);
 	}
+#endif
+
+	bool spriteText(const char* text, int layer, IVec2 pos, byte bg, byte fill, byte outline) {
+		return spriteText(text, layers[layer], pos, bg, fill, outline);
+	}
+
+	// Draw text as 8x8 sprites using the pixel font. Returns true if any pixel changed.
+	bool spriteText(const char* text, int layer, IVec2 pos) {
+		return spriteText(text, layers[layer], pos, textBackground, textFill, textOutline);
+	}
+
+	// Draw text into any layer, ex. one that is not composited.
+	// The text is rendered once per string and colors (see GlyphCache), then blitted.
+	bool spriteText(const char* text, Layer& layer, IVec2 pos, byte bg, byte fill, byte outline) {
+		return layer.drawSprite(glyphs.text(text, bg, fill, outline, alphaColor), pos, alphaColor);
+	}
+
+	bool spriteText(const char* text, Layer& layer, IVec2 pos) {
+		return spriteText(text, layer, pos, textBackground, textFill, textOutline);
+	}
+
+	// Composite the layers and send the cells that changed since the last call to the output.
+	// Only the tiles dirtied in some layer since then are recomposited and compared to the screen,
+	// and the changed cells of each row go out as runs in a single frame.
+	// drawUs is the time the caller took to draw the layers, reported in frameStats.
+	void invalidate(double drawUs = 0) {
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point t0 = Clock::now();
+
+		frameStats = FrameStats();
+		frameStats.drawUs = drawUs;
 
-	void spriteText(const char* text, int layer, IVec2 pos, byte bg, byte fill, byte outline) {
-		int i = -1;
-		IVec2 cPos = pos;
+		// Collect the dirty tiles of all layers in window tiles
+		renderBuffer.clearDirty();
+		for (size_t i = 0; i < layers.size(); i++) {
+			Layer& l = layers[i];
 
-		while (text[++i]) { 
+			for (int ty = 0; ty < l.tilesY(); ty++) {
+				for (int tx = 0; tx < l.tilesX(); tx++) {
+					if (!l.tileDirty(tx, ty)) continue;
 
-			if (text[i] == '\n') {
-				cPos.y += 8;
-				cPos.x = pos.x;
-				continue;
+					IVec2 start = l.pos + IVec2(tx, ty) * LAYER_TILE;
+					renderBuffer.markDirty(start, start + IVec2(LAYER_TILE, LAYER_TILE));
+				}
 			}
-			Byte88 sprite = getCharSprite(text[i], bg, fill, outline);
-			layers[layer].drawSprite(sprite, cPos, alphaColor);
+			l.clearDirty();
+		}
+		if (fullRepaint) renderBuffer.markAllDirty();
 
-			cPos.x += 8;
+		// Adjacent dirty tiles of a row are composited together, so the kernels work on longer rows
+		for (int ty = 0; ty < renderBuffer.tilesY(); ty++) {
+			for (int tx = 0, end; nextDirtySpan(ty, tx, end); tx = end) {
+				compositeRect(IVec2(tx, ty) * LAYER_TILE, IVec2(end, ty + 1) * LAYER_TILE);
+				frameStats.tiles += end - tx;
+			}
 		}
-	}
+		Clock::time_point t1 = Clock::now();
+
+		// Only the rows of tile rows with a dirty tile are compared
+		runs.clear();
+		for (int ty = 0; ty < renderBuffer.tilesY(); ty++) {
+			int tx = 0, end;
+			if (!nextDirtySpan(ty, tx, end)) continue;
 
-	// Draw text as 8x8 sprites using the pixel font.
-	void spriteText(const char* text, int layer, IVec2 pos) {
-		spriteText(text, layer, pos, textBackground, textFill, textOutline);
+			int yEnd = min((ty + 1) * LAYER_TILE, height);
+			for (int y = ty * LAYER_TILE; y < yEnd; y++) findChangedRuns(y, ty);
+		}
+		Clock::time_point t2 = Clock::now();
+
+		output->beginFrame();
+		for (const CellRun& r : runs) {
+			output->writeRun(r.x, r.y, renderBuffer.row(r.y) + r.x, r.n);
+			frameStats.cells += r.n;
+		}
+		output->endFrame();
+		Clock::time_point t3 = Clock::now();
+
+		fullRepaint = false;
+
+		frameStats.runs = (int)runs.size();
+		frameStats.compositeUs = std::chrono::duration<double, std::micro>(t1 - t0).count();
+		frameStats.diffUs = std::chrono::duration<double, std::micro>(t2 - t1).count();
+		frameStats.outputUs = std::chrono::duration<double, std::micro>(t3 - t2).count();
+		if (onFrame != NULL) onFrame(frameStats);
 	}
 
-	void invalidate() {
-		renderBuffer.setAll(alphaColor);
+	// Recomposite the layers in a rectangle of the window, from start (inclusive) to end (exclusive).
+	void compositeRect(IVec2 start, IVec2 end) {
+		end = IVec2(min(end.x, width), min(end.y, height));
 
+		renderBuffer.fill(start, end, alphaColor);
 		for (int i = 0; i < layers.size(); i++) {
-			renderBuffer.overlay(layers[i], alphaColor);
+			renderBuffer.overlay(layers[i], alphaColor, start, end);
 		}
+	}
+
+	// Find the next span of adjacent dirty window tiles in tile row ty, from tile tx on.
+	// Returns false if there is none, else tx is its first tile and end the tile after its last.
+	bool nextDirtySpan(int ty, int& tx, int& end) const {
+		while (tx < renderBuffer.tilesX() && !renderBuffer.tileDirty(tx, ty)) tx++;
+		if (tx == renderBuffer.tilesX()) return false;
+
+		end = tx + 1;
+		while (end < renderBuffer.tilesX() && renderBuffer.tileDirty(end, ty)) end++;
+		return true;
+	}
+
+	// Add the cells start to end - 1 of row y as a run, and copy them to the back buffer
+	void addRun(int y, int start, int end) {
+		runs.push_back(CellRun{ start, y, end - start });
+		memcpy_s(backBuffer.row(y) + start, end - start, renderBuffer.row(y) + start, end - start);
+	}
 
-		for (int i = 0; i < width * height; i++) {
+	// Collect the changed cells of row y in the dirty tile spans of its tile row ty as runs, and copy them to the back buffer.
+	// A run continues over up to output->runGap() unchanged cells rather than being split, also from one span into the next.
+	void findChangedRuns(int y, int ty) {
+		const byte* render = renderBuffer.row(y);
+		const byte* back = backBuffer.row(y);
+		int gap = output->runGap();
+		int runStart = -1, runEnd = -1;	// Current run, end exclusive
 
-			if (renderBuffer[i] != backBuffer[i]) {	
-				setCursorPosition(i / width, i % width);
-				setColor(renderBuffer[i]);
-				printf(" ");
+		for (int tx = 0, end; nextDirtySpan(ty, tx, end); tx = end) {
+			int xEnd = min(end * LAYER_TILE, width);
 
-				backBuffer[i] = renderBuffer[i];
+			for (int x = tx * LAYER_TILE; x < xEnd; x++) {
+				if (!fullRepaint && render[x] == back[x]) continue;
+
+				if (runStart >= 0 && x - runEnd <= gap) {
+					runEnd = x + 1;
+					continue;
+				}
+				if (runStart >= 0) addRun(y, runStart, runEnd);
+				runStart = x;
+				runEnd = x + 1;
 			}
 		}
+		if (runStart >= 0) addRun(y, runStart, runEnd);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include "PixelFont.h"
+#include "Layer.h"
+
+// Caches the outlined PixelFont glyphs per colors, and whole texts rendered with them,
+// so text that is drawn again is a single blit instead of expanding and outlining every character.
+class GlyphCache {
+private:
+	// A text rendered to its own layer; pixels outside the glyphs hold the alpha it was made for
+	struct TextRun {
+		std::string text;	// Checked on lookup, as entries are keyed by hash
+		byte colors[4];
+		Layer pixels;
+	};
+
+	std::unordered_map<uint32_t, Byte88> glyphs;
+	std::unordered_map<UINT64, TextRun> runs;
+
+	static UINT64 runKey(const char* text, const byte* colors) {
+		UINT64 h = 14695981039346656037ULL;	// FNV-1a
+		for (int i = 0; i < 4; i++) h = (h ^ colors[i]) * 1099511628211ULL;
+		for (; *text; text++) h = (h ^ (byte)*text) * 1099511628211ULL;
+		return h;
+	}
+
+public:
+	// Texts drawn with changing contents (ex. engine statistics) would fill the cache;
+	// it is emptied when it reaches this many runs.
+	size_t maxRuns;
+	size_t hits;
+	size_t misses;
+
+	GlyphCache() : maxRuns(64), hits(0), misses(0) {};
+
+	// The sprite of a character, as getCharSprite would return it
+	const Byte88& glyph(char chr, byte bg, byte fill, byte outline) {
+		uint32_t key = (byte)chr | bg << 8 | fill << 16 | (uint32_t)outline << 24;
+
+		auto it = glyphs.find(key);
+		if (it == glyphs.end()) it = glyphs.emplace(key, getCharSprite(chr, bg, fill, outline)).first;
+		return it->second;
+	}
+
+	// A text rendered like GameWindow::spriteText: glyphs 8 pixels apart, '\n' starting a new line.
+	// Pixels not covered by a glyph and glyph pixels equal to alpha are alpha.
+	const Layer& text(const char* str, byte bg, byte fill, byte outline, byte alpha) {
+		const byte colors[4] = { bg, fill, outline, alpha };
+		UINT64 key = runKey(str, colors);
+
+		auto it = runs.find(key);
+		if (it != runs.end() && it->second.text == str && memcmp(it->second.colors, colors, 4) == 0) {
+			hits++;
+			return it->second.pixels;
+		}
+		misses++;
+
+		int cols = 0, lines = 1;
+		for (int i = 0, c = 0; str[i]; i++) {
+			if (str[i] == '\n') { lines++; c = 0; continue; }
+			cols = max(cols, ++c);
+		}
+
+		Layer pixels = Layer(max(cols * 8, 1), lines * 8, alpha);
+		IVec2 cPos = IVec2(0, 0);
+		for (int i = 0; str[i]; i++) {
+			if (str[i] == '\n') {
+				cPos.y += 8;
+				cPos.x = 0;
+				continue;
+			}
+			pixels.drawSprite(glyph(str[i], bg, fill, outline), cPos, alpha);
+			cPos.x += 8;
+		}
+
+		if (it == runs.end() && runs.size() >= maxRuns) runs.clear();
+		TextRun& run = runs[key];
+		run.text = str;
+		memcpy(run.colors, colors, 4);
+		run.pixels = std::move(pixels);
+		return run.pixels;
+	}
+};
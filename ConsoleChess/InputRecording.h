@@ -0,0 +1,199 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "Platform.h"
+
+// Recording and replay of the key and mouse events GameWindow dispatches, so a session can be
+// played back as reproducible load (ex. to time onMouse -> redraw -> invalidate without a console).
+//
+// File format, little-endian: the 4 bytes "CCIR", a version byte, then one record per event:
+//   u8 type (RecordKey / RecordMouse), u32 microseconds since the previous event, then
+//   key:   u8 down, u16 repeat count, u16 virtual key code, u16 scan code, u16 character, u32 control keys
+//   mouse: u16 x, u16 y, u32 buttons, u32 control keys, u32 event flags
+
+enum RecordType {
+	RecordKey = 1,
+	RecordMouse = 2
+};
+
+#define INPUT_RECORDING_VERSION 1
+
+struct RecordedEvent {
+	byte type;
+	UINT64 timeUs;	// Since the start of the recording
+	KEY_EVENT_RECORD key;
+	MOUSE_EVENT_RECORD mouse;
+
+	RecordedEvent() : type(0), timeUs(0), key(), mouse() {};
+};
+
+// Appends the dispatched events to a file.
+class InputRecorder {
+private:
+	FILE* file;
+	std::chrono::steady_clock::time_point start;
+	UINT64 lastUs;
+
+	void put(UINT64 v, int bytes) {
+		for (int i = 0; i < bytes; i++) fputc((int)(v >> (8 * i)) & 0xFF, file);
+	}
+
+	// Write the record header, returning false if the file is not open
+	bool begin(byte type) {
+		if (file == NULL) return false;
+
+		UINT64 now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		put(type, 1);
+		put((std::min)(now - lastUs, (UINT64)0xFFFFFFFF), 4);
+		lastUs = now;
+		return true;
+	}
+
+public:
+	InputRecorder() : file(NULL), lastUs(0) {};
+
+	~InputRecorder() {
+		close();
+	}
+
+	// Start recording to a new file. Returns false if it cannot be created.
+	bool open(const char* path) {
+		close();
+		if (fopen_s(&file, path, "wb") != 0) {
+			file = NULL;
+			return false;
+		}
+
+		fwrite("CCIR", 1, 4, file);
+		put(INPUT_RECORDING_VERSION, 1);
+		start = std::chrono::steady_clock::now();
+		lastUs = 0;
+		return true;
+	}
+
+	void close() {
+		if (file != NULL) fclose(file);
+		file = NULL;
+	}
+
+	void record(const KEY_EVENT_RECORD& evt) {
+		if (!begin(RecordKey)) return;
+
+		put(evt.bKeyDown ? 1 : 0, 1);
+		put(evt.wRepeatCount, 2);
+		put(evt.wVirtualKeyCode, 2);
+		put(evt.wVirtualScanCode, 2);
+		put((WORD)evt.uChar.UnicodeChar, 2);
+		put(evt.dwControlKeyState, 4);
+		fflush(file);
+	}
+
+	void record(const MOUSE_EVENT_RECORD& evt) {
+		if (!begin(RecordMouse)) return;
+
+		put((WORD)evt.dwMousePosition.X, 2);
+		put((WORD)evt.dwMousePosition.Y, 2);
+		put(evt.dwButtonState, 4);
+		put(evt.dwControlKeyState, 4);
+		put(evt.dwEventFlags, 4);
+		fflush(file);
+	}
+};
+
+// Plays back a recording, at the recorded speed or as fast as possible.
+class InputReplay {
+private:
+	std::vector<RecordedEvent> events;
+	size_t nextEvent;
+	bool realtime;
+	std::chrono::steady_clock::time_point start;
+
+	static UINT64 get(const byte*& p, int bytes) {
+		UINT64 v = 0;
+		for (int i = 0; i < bytes; i++) v |= (UINT64)*p++ << (8 * i);
+		return v;
+	}
+
+public:
+	InputReplay() : nextEvent(0), realtime(false) {};
+
+	// Load a recording. Returns false if the file cannot be read or is not a recording.
+	bool load(const char* path) {
+		FILE* f;
+		if (fopen_s(&f, path, "rb") != 0) return false;
+
+		std::vector<byte> data;
+		byte buf[4096];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+		fclose(f);
+
+		if (data.size() < 5 || memcmp(data.data(), "CCIR", 4) != 0 || data[4] != INPUT_RECORDING_VERSION) return false;
+
+		events.clear();
+		const byte* p = data.data() + 5;
+		const byte* end = data.data() + data.size();
+		UINT64 time = 0;
+
+		while (end - p >= 5) {
+			RecordedEvent e;
+			e.type = (byte)get(p, 1);
+			time += get(p, 4);
+			e.timeUs = time;
+
+			if (e.type == RecordKey && end - p >= 13) {
+				e.key.bKeyDown = get(p, 1) != 0;
+				e.key.wRepeatCount = (WORD)get(p, 2);
+				e.key.wVirtualKeyCode = (WORD)get(p, 2);
+				e.key.wVirtualScanCode = (WORD)get(p, 2);
+				e.key.uChar.UnicodeChar = (WORD)get(p, 2);
+				e.key.dwControlKeyState = (DWORD)get(p, 4);
+			}
+			else if (e.type == RecordMouse && end - p >= 16) {
+				e.mouse.dwMousePosition.X = (SHORT)get(p, 2);
+				e.mouse.dwMousePosition.Y = (SHORT)get(p, 2);
+				e.mouse.dwButtonState = (DWORD)get(p, 4);
+				e.mouse.dwControlKeyState = (DWORD)get(p, 4);
+				e.mouse.dwEventFlags = (DWORD)get(p, 4);
+			}
+			else break;	// Unknown or truncated record: keep the events before it
+
+			events.push_back(e);
+		}
+		return true;
+	}
+
+	// Start from the first event. With realtime, events are due at their recorded time after this call.
+	void rewind(bool realtime) {
+		this->realtime = realtime;
+		nextEvent = 0;
+		start = std::chrono::steady_clock::now();
+	}
+
+	bool finished() const { return nextEvent >= events.size(); }
+	size_t size() const { return events.size(); }
+
+	// Get the next event once it is due, waiting at most maxWaitMs for it (INFINITE to wait until it is).
+	// Returns false if no event is due by then.
+	bool next(RecordedEvent& e, DWORD maxWaitMs) {
+		if (finished()) return false;
+
+		if (realtime) {
+			auto due = start + std::chrono::microseconds(events[nextEvent].timeUs);
+			auto now = std::chrono::steady_clock::now();
+
+			if (due > now) {
+				if (maxWaitMs != INFINITE && due - now > std::chrono::milliseconds(maxWaitMs)) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(maxWaitMs));
+					return false;
+				}
+				std::this_thread::sleep_until(due);
+			}
+		}
+		e = events[nextEvent++];
+		return true;
+	}
+};
@@ -3,32 +3,48 @@
 #include "SpriteDefs.h"
 
 class King : public PieceDef {
+private:
+	UINT64 stepTable[64];	// Per square: the squares one king step away
+
 public:
 	byte rookId;
 
-	King(byte id, byte rookId, Byte88 sprite) : PieceDef(id, true, sprite) { 
+	King(byte id, byte rookId, Byte88 sprite) : PieceDef(id, true, sprite), stepTable{ } { 
 		this->rookId = rookId;
+
+		for (int k = 0; k < 64; k++) {
+			for (int i = -1; i <= 1; i++) {
+				for (int j = -1; j <= 1; j++) {
+					IVec2 v = IVec2((k & 7) + i, (k >> 3) + j);
+					if ((i != 0 || j != 0) && v.in88Square()) stepTable[k] |= SQUARE_BIT(POS_TO_INDEX(v));
+				}
+			}
+		}
 	}
 
-	bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) override {
-		IVec2 delta = end - start;
+	// Check the castling move of the unmoved king at start, two squares towards end.
+	bool canCastle(IVec2 start, IVec2 end, const BoardState& board) const {
 		Piece p = board.getPiece(start);
+		IVec2 dir = IVec2((end.x > start.x) ? 1 : -1, 0);
+		IVec2 rookPos = IVec2((end.x > start.x) ? 7 : 0, start.y);
+		Piece rook = board.getPiece(rookPos);
 
-		if (start == end) return false; 
+		if (rook.id != rookId || rook.team != p.team) { return false; }
 
-		if (!p.moved && abs(delta.x) == 2 && delta.y == 0) {
-			IVec2 dir = IVec2((end.x > start.x) ? 1 : -1, 0);
-			IVec2 rookPos = IVec2((end.x > start.x) ? 7 : 0, start.y);
-			Piece rook = board.getPiece(rookPos);
+		for (IVec2 sqr = start + dir; sqr != rookPos; sqr += dir) {
+			if (board[sqr] != 0) { return false; }
+		}
 
-			if (rook.id != rookId || rook.team != p.team) { return false; }
+		return true;
+	}
 
-			for (IVec2 sqr = start + dir; sqr != rookPos; sqr += dir) {
-				if (board[sqr] != 0) { return false; }
-			}
+	bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) const override {
+		IVec2 delta = end - start;
+		Piece p = board.getPiece(start);
 
-			return true;
-		}
+		if (start == end) return false; 
+
+		if (!p.moved && abs(delta.x) == 2 && delta.y == 0) return canCastle(start, end, board);
 
 		if (board[end] == 0 || board.getPiece(end).team != p.team) 
 			return abs(delta.x) <= 1 && abs(delta.y) <= 1;
@@ -36,27 +52,59 @@ public:
 		return false;
 	}
 
+	void generateMoves(IVec2 start, const BoardState& board, MoveList& moves) const override {
+		Piece p = board.getPiece(start);
+		int pos = POS_TO_INDEX(start);
+
+		moves.addTargets(pos, stepTable[pos] & ~board.teamBB[p.team]);
+
+		if (p.moved) return;
+
+		for (int i = -2; i <= 2; i += 4) {
+			IVec2 end = start + IVec2(i, 0);
+			if (end.in88Square() && canCastle(start, end, board)) moves.add(pos, POS_TO_INDEX(end));
+		}
+	}
+
+	// Castling only moves to empty squares, so only plain steps can attack.
+	UINT64 attackers(IVec2 pos, bool team, const BoardState& board) const override {
+		return stepTable[POS_TO_INDEX(pos)] & board.pieces(id, team);
+	}
+
+	bool describesAttacks() const override {
+		return true;
+	}
+
+	UINT64 attacks(int pos, bool team, UINT64 occ) const override {
+		return stepTable[pos];
+	}
+
+	// Castling also moves the rook
+	bool isPlainMove(IVec2 start, IVec2 end, const BoardState& board) const override {
+		return abs(end.x - start.x) < 2;
+	}
+
 	// Perform a king move. Return value represents promotion and is thus false.
-	bool makeMove(IVec2 start, IVec2 end, BoardState& board) override {
+	bool makeMove(IVec2 start, IVec2 end, BoardState& board) const override {
 		// Get king piece and move delta
 		Piece p = board.getPiece(start);
 		IVec2 delta = end - start;
 
 		// Normal move
 		if (abs(delta.x) < 2) {
-			board[end] = board[start] | PIECE_MOVED;
-			board[start] = 0;
+			board.set(end, board[start] | PIECE_MOVED);
+			board.set(start, 0);
 		}
 		// Castle
 		else {
 			IVec2 dir = IVec2((end.x > start.x) ? 1 : -1, 0);
 			IVec2 rookPos = IVec2((end.x > start.x) ? 7 : 0, start.y);
 			
-			board[start + 2 * dir] = board[start] | PIECE_MOVED;
-			board[start] = 0;
+			board.set(start + 2 * dir, board[start] | PIECE_MOVED);
+			board.set(start, 0);
 
-			board[start + dir] = board[rookPos] | PIECE_MOVED;
-			board[rookPos] = 0;
+			board.set(start + dir, board[rookPos] | PIECE_MOVED);
+			board.set(rookPos, 0);
 		}
 
 		return false;
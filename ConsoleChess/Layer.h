@@ -1,22 +1,124 @@
 #pragma once
 
 #include <stdexcept>
-#include <Windows.h>
+#include "Platform.h"
 #include "IVec2.h"
-#include <functional>
+#include "Byte88.h"
+#include <memory>
+#include <vector>
 
 // Simple macro to clamp a value between a min and a max
 #define CLAMP(v, mi, ma) min(max(v, mi), ma)
 
+// Size of the dirty tracking tiles, matching board squares and the sprite grid
+#define LAYER_TILE 8
+
+// One block of memory the buffers of a window's layers are carved from, so they sit next to
+// each other and cost a single allocation. The block never moves: carved buffers stay valid
+// until the arena is reserved again or destroyed, and when it is full layers allocate their own.
+class LayerArena {
+private:
+	std::unique_ptr<byte[]> block;
+	size_t capacity;
+	size_t used;
+
+public:
+	LayerArena() : capacity(0), used(0) {};
+
+	// Allocate a new block. Only call when no layer uses the previous one.
+	void reserve(size_t bytes) {
+		block.reset(bytes ? new byte[bytes] : NULL);
+		capacity = bytes;
+		used = 0;
+	}
+
+	// Take the next bytes of the block, or return NULL if it is full.
+	// Buffers start on a cache line of the block.
+	byte* carve(size_t bytes) {
+		if (used + bytes > capacity) return NULL;
+
+		byte* p = block.get() + used;
+		used = (std::min)(capacity, (used + bytes + 63) & ~(size_t)63);
+		return p;
+	}
+
+	size_t bytesUsed() const { return used; }
+};
+
+// 2D byte buffer composited by GameWindow.
+// Every write that changes a byte marks its 8x8 tile dirty, so the compositor
+// only recomposites and diffs the tiles changed since the last frame.
 class Layer {
 
 protected:
 
 	byte *buffer;
+	bool ownsBuffer;	// False for buffers carved from an arena or given by the caller
 	int w;	
 	int h;	
 	int sz; 
 
+	int tilesW;	// Tiles per row
+	std::vector<UINT64> dirty;	// One bit per tile, in row-major order
+
+	void initTiles() {
+		tilesW = (w + LAYER_TILE - 1) / LAYER_TILE;
+		int nTiles = tilesW * ((h + LAYER_TILE - 1) / LAYER_TILE);
+		dirty.assign((nTiles + 63) / 64, ~(UINT64)0);
+	}
+
+	void markTile(int x, int y) {
+		int t = (y / LAYER_TILE) * tilesW + x / LAYER_TILE;
+		dirty[t >> 6] |= SQUARE_BIT(t & 63);
+	}
+
+	// Point the layer to a new buffer of sz bytes, from the arena if it has room
+	void allocate(LayerArena* arena) {
+		buffer = arena ? arena->carve(sz) : NULL;
+		ownsBuffer = buffer == NULL;
+		if (ownsBuffer) buffer = new byte[sz];
+	}
+
+	void release() {
+		if (ownsBuffer) delete[] buffer;
+		buffer = NULL;
+		ownsBuffer = false;
+	}
+
+	typedef Byte88Lanes::Vec Vec;
+
+	// Write Byte88Lanes::Width bytes from (x, y) on, marking the tiles of the bytes that change.
+	void storeSpan(int x, int y, Vec v) {
+		byte* p = buffer + y * w + x;
+		UINT64 changed = ~Byte88Lanes::equalMask(Byte88Lanes::load(p), v) & (~(UINT64)0 >> (64 - Byte88Lanes::Width));
+		if (!changed) return;
+
+		Byte88Lanes::store(p, v);
+		while (changed) {
+			int i = lsbIndex(changed);
+			markTile(x + i, y);
+			changed &= ~(UINT64)0 << ((x + i) / LAYER_TILE * LAYER_TILE + LAYER_TILE - x);	// Skip to the next tile
+		}
+	}
+
+	// Call a per-pixel function taking (value, IVec2 pos), (value, int index) or (value)
+	template <class F>
+	static auto callPixel(F& f, byte v, int x, int y, int i, int) -> decltype((byte)f(v, IVec2(x, y))) { return f(v, IVec2(x, y)); }
+	template <class F>
+	static auto callPixel(F& f, byte v, int x, int y, int i, long) -> decltype((byte)f(v, i)) { return f(v, i); }
+	template <class F>
+	static byte callPixel(F& f, byte v, int x, int y, int i, ...) { return f(v); }
+
+	// Write a byte, marking its tile if the value changes. Returns true if it changed.
+	bool setPixel(int x, int y, byte val) {
+		byte& b = buffer[y * w + x];
+		if (b == val) return false;
+
+		b = val;
+		markTile(x, y);
+		return true;
+	}
+
 public:
 
 	size_t width() { return w; }
@@ -25,82 +127,218 @@ public:
 
 	IVec2 pos;
 
-	Layer() : w(0), h(0), sz(0), buffer(NULL) {};
+	Layer() : buffer(NULL), ownsBuffer(false), w(0), h(0), sz(0), tilesW(0) {};
 
-	Layer(Byte88 b, IVec2 pos) : w(8), h(8), sz(64) {
-		buffer = (byte*)malloc(64);
+	Layer(Byte88 b, IVec2 pos) : w(8), h(8), sz(64), pos(pos) {
+		allocate(NULL);
 		memcpy_s(buffer, sz, b.data, sz);
+		initTiles();
 	}
 
 	Layer(int w, int h) : w(w), h(h), sz(w * h), pos(0, 0) {
-		buffer = (byte*)malloc(sz);
+		allocate(NULL);
 		std::fill_n(buffer, sz, 0);
+		initTiles();
 	}
 
 	Layer(int w, int h, byte val) : w(w), h(h), sz(w* h), pos(0, 0) {
-		buffer = (byte*)malloc(sz);
+		allocate(NULL);
 		std::fill_n(buffer, sz, val);
+		initTiles();
 	}
 
 	Layer(int w, int h, byte val, IVec2 pos) : w(w), h(h), sz(w * h), pos(pos) {
-		buffer = (byte*)malloc(sz);
+		allocate(NULL);
+		std::fill_n(buffer, sz, val);
+		initTiles();
+	}
+
+	// Create a layer whose buffer is carved from an arena (see LayerArena).
+	Layer(LayerArena& arena, int w, int h, byte val, IVec2 pos) : w(w), h(h), sz(w * h), pos(pos) {
+		allocate(&arena);
 		std::fill_n(buffer, sz, val);
+		initTiles();
 	}
 	
-	Layer(const Layer &other) : w(other.w), h(other.h), sz(other.sz), pos(other.pos) {
-		buffer = (byte*)malloc(sz);
+	Layer(const Layer &other) : w(other.w), h(other.h), sz(other.sz), tilesW(other.tilesW), dirty(other.dirty), pos(other.pos) {
+		allocate(NULL);
 		memcpy_s(buffer, sz, other.buffer, sz);
 	}
 
-	Layer(int w, int h, IVec2 pos, byte* data) : w(w), h(h), sz(w* h), pos(pos) { buffer = data; }
+	Layer(Layer&& other) noexcept : buffer(other.buffer), ownsBuffer(other.ownsBuffer), w(other.w), h(other.h), sz(other.sz),
+		tilesW(other.tilesW), dirty(std::move(other.dirty)), pos(other.pos) {
+		other.buffer = NULL;
+		other.ownsBuffer = false;
+		other.w = other.h = other.sz = other.tilesW = 0;
+	}
+
+	// Wrap a buffer owned by the caller.
+	Layer(int w, int h, IVec2 pos, byte* data) : ownsBuffer(false), w(w), h(h), sz(w* h), pos(pos) { buffer = data; initTiles(); }
+
+	~Layer() {
+		release();
+	}
+
+	// Copy pos, size and contents. The buffer is reused if it has the same size.
+	Layer& operator=(const Layer& buff) {
+		if (this == &buff) return *this;
 
-	Layer& operator=(const Layer& buff) {	// Copy pos & size info
+		if (buff.sz != sz || buffer == NULL) {
+			release();
+			sz = buff.sz;
+			allocate(NULL);
+		}
 		pos = buff.pos;
 		w = buff.w;
 		h = buff.h;
-		sz = buff.sz;
+		tilesW = buff.tilesW;
+		dirty = buff.dirty;
 
-		buffer = (byte*)malloc(sz);
 		memcpy_s(buffer, sz, buff.buffer, sz);
 		return *this;
 	}
 
-	void operator~() {
-		free(buffer);
+	Layer& operator=(Layer&& buff) noexcept {
+		if (this == &buff) return *this;
+
+		release();
+		buffer = buff.buffer;
+		ownsBuffer = buff.ownsBuffer;
+		pos = buff.pos;
+		w = buff.w;
+		h = buff.h;
+		sz = buff.sz;
+		tilesW = buff.tilesW;
+		dirty = std::move(buff.dirty);
+
+		buff.buffer = NULL;
+		buff.ownsBuffer = false;
+		buff.w = buff.h = buff.sz = buff.tilesW = 0;
+		return *this;
+	}
+
+	// DIRTY TILES
+	// Tile (tx, ty) covers the pixels from (8 tx, 8 ty) to (8 tx + 7, 8 ty + 7). A new layer is all dirty.
+
+	int tilesX() const { return tilesW; }
+	int tilesY() const { return (h + LAYER_TILE - 1) / LAYER_TILE; }
+
+	bool tileDirty(int tx, int ty) const {
+		int t = ty * tilesW + tx;
+		return (dirty[t >> 6] >> (t & 63)) & 1;
+	}
+
+	bool anyDirty() const {
+		for (size_t i = 0; i < dirty.size(); i++) {
+			if (dirty[i]) return true;
+		}
+		return false;
+	}
+
+	// Mark the tiles overlapping the pixel rectangle from start (inclusive) to end (exclusive).
+	void markDirty(IVec2 start, IVec2 end) {
+		start = IVec2(CLAMP(start.x, 0, w), CLAMP(start.y, 0, h));
+		end = IVec2(CLAMP(end.x, 0, w), CLAMP(end.y, 0, h));
+
+		for (int ty = start.y / LAYER_TILE; ty * LAYER_TILE < end.y; ty++) {
+			for (int tx = start.x / LAYER_TILE; tx * LAYER_TILE < end.x; tx++) markTile(tx * LAYER_TILE, ty * LAYER_TILE);
+		}
+	}
+
+	void markAllDirty() {
+		std::fill(dirty.begin(), dirty.end(), ~(UINT64)0);
+	}
+
+	void clearDirty() {
+		std::fill(dirty.begin(), dirty.end(), 0);
 	}
 
+	// Change the size, keeping the overlapping contents. The new buffer is always allocated by the layer.
 	void resize(int width, int height) {
 		byte* oldData = buffer;
-		buffer = (byte*)malloc(static_cast<size_t>(width) * height);
+		bool ownedOld = ownsBuffer;
+		int oldW = w, oldH = h;
 
-		for (int y = 0; y < min(height, h); h++) {
-			memcpy_s(buffer + y * width, min(width, w), oldData + y * w, min(width, w));
+		sz = width * height;
+		allocate(NULL);
+		std::fill_n(buffer, sz, 0);
+
+		for (int y = 0; y < min(height, oldH); y++) {
+			memcpy_s(buffer + y * width, min(width, oldW), oldData + y * oldW, min(width, oldW));
 		}
-		free(oldData); 
+		if (ownedOld) delete[] oldData;
 		w = width;
 		h = height;
-		sz = width * height;
+		initTiles();
 	}
 
 	void setAll(byte val) {
-		std::fill_n(buffer, sz, val);
+		fill(IVec2(0, 0), IVec2(w, h), val);
+	}
+
+	// Fill a rectangle in layer coordinates, from start (inclusive) to end (exclusive).
+	void fill(IVec2 start, IVec2 end, byte val) {
+		start = IVec2(CLAMP(start.x, 0, w), CLAMP(start.y, 0, h));
+		end = IVec2(CLAMP(end.x, 0, w), CLAMP(end.y, 0, h));
+		Vec v = Byte88Lanes::splat(val);
+
+		for (int y = start.y; y < end.y; y++) {
+			int x = start.x;
+			for (; x + Byte88Lanes::Width <= end.x; x += Byte88Lanes::Width) storeSpan(x, y, v);
+			for (; x < end.x; x++) setPixel(x, y, val);
+		}
 	}
 
 	// Replace values in buffer
 	void replace(byte oldVal, byte newVal) {
-		for (int i = 0; i < sz; i++) {
-			if (buffer[i] == oldVal) buffer[i] = newVal;
+		Vec o = Byte88Lanes::splat(oldVal);
+		Vec n = Byte88Lanes::splat(newVal);
+
+		for (int y = 0; y < h; y++) {
+			const byte* src = buffer + y * w;
+			int x = 0;
+			for (; x + Byte88Lanes::Width <= w; x += Byte88Lanes::Width) {
+				Vec v = Byte88Lanes::load(src + x);
+				storeSpan(x, y, Byte88Lanes::select(Byte88Lanes::equalBytes(v, o), n, v));
+			}
+			for (; x < w; x++) {
+				if (src[x] == oldVal) setPixel(x, y, newVal);
+			}
 		}
 	}
 
-	void replaceData(const Layer& other) {
+	// Map every value through a 256 entry table, ex. a palette.
+	void remap(const byte* table) {
+		transform([table](byte v) { return table[v]; });
+	}
+
+	// Copy the contents of a layer of the same size, marking only the tiles that differ.
+	// Returns true if any pixel changed.
+	bool replaceData(const Layer& other) {
+		bool changed = false;
+
 		if (other.w != w || other.h != h)
 			throw std::runtime_error("Cannot overlay with different size buffer");
 
-		memcpy_s(buffer, w, other.buffer, w);
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) changed |= setPixel(x, y, other.buffer[y * w + x]);
+		}
+		return changed;
+	}
+
+	// Write an 8x8 block at the given tile, ex. a board square, ignoring no pixels.
+	void setTile(IVec2 tile, const Byte88& content) {
+		IVec2 start = tile * LAYER_TILE;
+		IVec2 end = IVec2(CLAMP(start.x + 8, 0, w), CLAMP(start.y + 8, 0, h));
+
+		for (int y = max(start.y, 0); y < end.y; y++) {
+			for (int x = max(start.x, 0); x < end.x; x++) setPixel(x, y, content[(y - start.y) << 3 | (x - start.x)]);
+		}
 	}
 
-	void drawSprite(const Byte88& sprite, IVec2 layerPos, byte alpha) {
+	// Draw the pixels of a sprite that are not alpha. Returns true if any pixel changed.
+	bool drawSprite(const Byte88& sprite, IVec2 layerPos, byte alpha) {
+		bool changed = false;
 
 		IVec2 start = IVec2(CLAMP(layerPos.x, 0, w), CLAMP(layerPos.y, 0, h));
 		IVec2 end = IVec2(CLAMP(layerPos.x + 8, 0, w), CLAMP(layerPos.y + 8, 0, h));
@@ -108,47 +346,87 @@ public:
 		for (int x = start.x; x < end.x; x++) {
 			for (int y = start.y; y < end.y; y++) {
 				IVec2 v = IVec2(x, y);
-				if (sprite[v - layerPos] != alpha) buffer[y * w + x] = sprite[v - layerPos];
+				if (sprite[v - layerPos] != alpha) changed |= setPixel(x, y, sprite[v - layerPos]);
 			}
 		}
+		return changed;
 	}
 
-	void overlay(const Layer &other, byte alpha) {
+	// Draw the pixels of another layer that are not alpha, its top left corner at layerPos
+	// (its own pos is ignored). Returns true if any pixel changed.
+	bool drawSprite(const Layer& sprite, IVec2 layerPos, byte alpha) {
+		bool changed = false;
 
-		IVec2 start = IVec2(CLAMP(other.pos.x, pos.x, pos.x + w), CLAMP(other.pos.y, pos.y, pos.y + h));
-		IVec2 end = IVec2(CLAMP(other.pos.x + other.w, pos.x, pos.x + w), CLAMP(other.pos.y + other.h, pos.y, pos.y + h));
+		IVec2 start = IVec2(CLAMP(layerPos.x, 0, w), CLAMP(layerPos.y, 0, h));
+		IVec2 end = IVec2(CLAMP(layerPos.x + sprite.w, 0, w), CLAMP(layerPos.y + sprite.h, 0, h));
 
-		for (int x = start.x; x < end.x; x++) {
-			for (int y = start.y; y < end.y; y++) {
-				IVec2 v = IVec2(x, y);
-				if (other[v - other.pos] != alpha) this->operator[](v - pos) = other[v - other.pos];
+		for (int y = start.y; y < end.y; y++) {
+			const byte* src = sprite.buffer + (y - layerPos.y) * sprite.w - layerPos.x;
+			for (int x = start.x; x < end.x; x++) {
+				if (src[x] != alpha) changed |= setPixel(x, y, src[x]);
 			}
 		}
+		return changed;
 	}
 
-	void transform(std::function<byte(byte)> func) {
-		for (int i = 0; i < sz; i++) buffer[i] = func(buffer[i]);
-		
+	void overlay(const Layer &other, byte alpha) {
+		overlay(other, alpha, pos, pos + IVec2(w, h));
 	}
 
-	void transform(std::function<byte(byte, int)> func) {
-		for (int i = 0; i < sz; i++) buffer[i] = func(buffer[i], i);
+	// Overlay only the part of other inside a rectangle given in window coordinates (like pos),
+	// from start (inclusive) to end (exclusive).
+	void overlay(const Layer &other, byte alpha, IVec2 rectStart, IVec2 rectEnd) {
+		IVec2 lo = IVec2(max(max(other.pos.x, pos.x), rectStart.x), max(max(other.pos.y, pos.y), rectStart.y));
+		IVec2 hi = IVec2(min(min(other.pos.x + other.w, pos.x + w), rectEnd.x), min(min(other.pos.y + other.h, pos.y + h), rectEnd.y));
+
+		Vec a = Byte88Lanes::splat(alpha);
+
+		for (int y = lo.y; y < hi.y; y++) {
+			const byte* src = other.buffer + (y - other.pos.y) * other.w - other.pos.x;	// Indexed by window x
+			const byte* dst = buffer + (y - pos.y) * w - pos.x;
+			int x = lo.x;
+
+			for (; x + Byte88Lanes::Width <= hi.x; x += Byte88Lanes::Width) {
+				Vec s = Byte88Lanes::load(src + x);
+				Vec d = Byte88Lanes::load(dst + x);
+				storeSpan(x - pos.x, y - pos.y, Byte88Lanes::select(Byte88Lanes::equalBytes(s, a), d, s));
+			}
+			for (; x < hi.x; x++) {
+				if (src[x] != alpha) setPixel(x - pos.x, y - pos.y, src[x]);
+			}
+		}
 	}
 
-	void transform(std::function<byte(byte, IVec2)> func) {
-		for (int x = 0; x < w; x++) {
-			for (int y = 0; y < h; y++) {
-				buffer[y * w + x] = func(buffer[y * w + x], IVec2(x, y));
+	// Set every pixel to func(value, IVec2 pos), func(value, int index) or func(value), in memory order.
+	// The function is inlined, and its results are compared and stored a vector at a time.
+	template <class F>
+	void transform(F func) {
+		byte values[Byte88Lanes::Width];
+
+		for (int y = 0; y < h; y++) {
+			const byte* src = buffer + y * w;
+			int x = 0;
+
+			for (; x + Byte88Lanes::Width <= w; x += Byte88Lanes::Width) {
+				for (int i = 0; i < Byte88Lanes::Width; i++) values[i] = callPixel(func, src[x + i], x + i, y, y * w + x + i, 0);
+				storeSpan(x, y, Byte88Lanes::load(values));
 			}
+			for (; x < w; x++) setPixel(x, y, callPixel(func, src[x], x, y, y * w + x, 0));
 		}
 	}
 
+	// Bytes of row y, for bulk reads and writes that do not mark tiles.
+	const byte* row(int y) const { return buffer + y * w; }
+	byte* row(int y) { return buffer + y * w; }
+
 	// Index operators (safe, throws runtime error to avoid access violation)
+	// The writable versions mark the tile of the index dirty, as the write cannot be observed.
 
 	byte& operator[](int i) {
-		if (i < 0 || i > sz)
+		if (i < 0 || i >= sz)
 			throw std::runtime_error("Index out of range");
 
+		markTile(i % w, i / w);
 		return buffer[i];
 	}
 
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "Platform.h"
+#include "ChessRules.h"
+#include "MoveList.h"
+
+// Legal moves and check status of a position, as ChessGame shows them: one target mask
+// per origin square and the checked pieces, like ChessRules::legalMoves and attackedCrits.
+struct LegalMoveSet {
+	UINT64 key;	// ChessRules::positionKey of the position
+	UINT64 targets[64];	// Squares the piece on each square can move to
+	UINT64 checks;	// Critical pieces of the side to move under attack
+	int nMoves;
+
+	LegalMoveSet() : key(0), targets{ }, checks(0), nMoves(0) {};
+
+	// Generate the moves of the side to move of rules, which is used as scratch space.
+	void compute(ChessRules& rules) {
+		key = rules.positionKey();
+		nMoves = rules.calculateLegalMoves(rules.currTeam);
+		rules.computeChecks(rules.currTeam);
+
+		memcpy(targets, rules.legalMoves, sizeof(targets));
+		checks = rules.attackedCrits;
+	}
+
+	bool checkmate() const { return nMoves == 0 && checks != 0; }
+	bool stalemate() const { return nMoves == 0 && checks == 0; }
+};
+
+// Least recently used cache of legal move sets, keyed by position key, so positions seen before
+// (the start position after a restart, positions reached again) need no move generation.
+class LegalMoveCache {
+private:
+	struct Entry {
+		LegalMoveSet set;
+		int prev;	// Towards the most recently used entry, -1 for the first
+		int next;
+	};
+
+	std::vector<Entry> entries;
+	std::unordered_map<UINT64, int> index;	// Position key -> entry
+	size_t capacity;
+	int head;	// Most recently used entry, -1 when empty
+	int tail;	// Least recently used entry
+
+	void unlink(int i) {
+		Entry& e = entries[i];
+		if (e.prev != -1) entries[e.prev].next = e.next;
+		else head = e.next;
+		if (e.next != -1) entries[e.next].prev = e.prev;
+		else tail = e.prev;
+	}
+
+	void pushFront(int i) {
+		entries[i].prev = -1;
+		entries[i].next = head;
+		if (head != -1) entries[head].prev = i;
+		head = i;
+		if (tail == -1) tail = i;
+	}
+
+public:
+	UINT64 hits;
+	UINT64 misses;
+
+	LegalMoveCache(size_t capacity = 1024) : capacity(capacity), head(-1), tail(-1), hits(0), misses(0) {
+		entries.reserve(capacity);
+		index.reserve(capacity);
+	};
+
+	// Get the moves of a position and mark them most recently used. Returns false if they are not cached.
+	bool find(UINT64 key, LegalMoveSet& out) {
+		auto it = index.find(key);
+		if (it == index.end()) {
+			misses++;
+			return false;
+		}
+
+		hits++;
+		unlink(it->second);
+		pushFront(it->second);
+		out = entries[it->second].set;
+		return true;
+	}
+
+	// Add or refresh the moves of a position, evicting the least recently used one when full.
+	void insert(const LegalMoveSet& set) {
+		int i;
+		auto it = index.find(set.key);
+
+		if (it != index.end()) {
+			i = it->second;
+			unlink(i);
+		}
+		else if (entries.size() < capacity) {
+			i = (int)entries.size();
+			entries.push_back(Entry());
+			index[set.key] = i;
+		}
+		else {
+			i = tail;
+			unlink(i);
+			index.erase(entries[i].set.key);
+			index[set.key] = i;
+		}
+
+		entries[i].set = set;
+		pushFront(i);
+	}
+
+	void clear() {
+		entries.clear();
+		index.clear();
+		head = tail = -1;
+	}
+
+	size_t size() const { return entries.size(); }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Platform.h"
+#include "IVec2.h"
+#include "Bitboard.h"
+
+// Capacity of a MoveList. Enough for any chess position, with room for fairy piece sets.
+#define MAX_MOVES 512
+
+// A move between two board indices
+struct Move {
+	byte start;
+	byte end;
+
+	IVec2 startPos() const { return IVec2(start & 7, start >> 3); }
+	IVec2 endPos() const { return IVec2(end & 7, end >> 3); }
+};
+
+// Fixed-capacity list of moves, filled by PieceDef::generateMoves.
+// The entries are left uninitialized, so creating a list is free.
+struct MoveList {
+	Move moves[MAX_MOVES];
+	int size;
+
+	MoveList() : size(0) {};
+
+	void clear() { size = 0; }
+
+	void add(Move m) {
+		if (size < MAX_MOVES) moves[size++] = m;
+	}
+
+	void add(int start, int end) {
+		add(Move{ (byte)start, (byte)end });
+	}
+
+	// Add a move from start to every square of the target set.
+	void addTargets(int start, UINT64 targets) {
+		while (targets) add(start, popLsb(targets));
+	}
+
+	Move& operator[](int i) { return moves[i]; }
+	const Move& operator[](int i) const { return moves[i]; }
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Platform.h"
+#include "ChessRules.h"
+#include "LegalMoveCache.h"
+
+// Hit counts of the ways MoveWorker answers requests
+struct MoveWorkerStats {
+	UINT64 cacheHits;	// Positions reached before, from the LegalMoveCache
+	UINT64 cacheMisses;	// Positions neither precomputed nor cached, generated on request
+	UINT64 speculativeHits;	// Precomputed after the previous position
+	size_t cached;	// Positions in the cache
+
+	MoveWorkerStats() : cacheHits(0), cacheMisses(0), speculativeHits(0), cached(0) {};
+};
+
+// Generates the legal moves of the game's positions on a worker thread, so the input thread never waits for them.
+// After answering a request it keeps going with the positions after each of the legal moves (the replies the
+// opponent will have to choose from), so the request after the next move is usually answered at once.
+// The positions requested are kept in a LegalMoveCache, which answers for positions reached again.
+class MoveWorker {
+private:
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;	// A job was given or the worker should quit
+	std::condition_variable done;	// The result of a request is ready
+
+	// Guarded by mutex
+	bool quit;
+	bool hasJob;
+	ChessRules job;	// Position of the last request
+	LegalMoveSet jobMoves;	// Its moves, if request found them
+	UINT64 generation;	// Incremented by every request, so the worker drops work on an older position
+	bool pending;	// The last request waits for its result
+	bool resultReady;
+	LegalMoveSet result;
+	std::vector<LegalMoveSet> speculative;	// Positions after the moves of the last computed request
+	LegalMoveCache cache;	// Positions requested
+	UINT64 speculativeHits;
+
+	ChessRules rules;	// Copy of the job the worker thread works on, kept to reuse its buffers
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (true) {
+			wake.wait(lock, [this]() { return quit || hasJob; });
+			if (quit) return;
+
+			rules = job;
+			UINT64 gen = generation;
+			bool answer = pending;
+			LegalMoveSet set;
+			if (!answer) set = jobMoves;
+			hasJob = false;
+			lock.unlock();
+
+			if (answer) set.compute(rules);
+
+			lock.lock();
+			if (gen != generation) continue;
+			if (answer) {
+				result = set;
+				resultReady = true;
+				pending = false;
+				cache.insert(set);
+				done.notify_all();
+				if (onReady != NULL) onReady();
+			}
+			speculative.clear();
+			lock.unlock();
+
+			// Speculate until the next request
+			MoveList moves;
+			for (int k = 0; k < 64; k++) moves.addTargets(k, set.targets[k]);
+			for (int i = 0; i < moves.size; i++) {
+				// Promotions wait for the choice of piece
+				if (rules.makeMove(moves[i].startPos(), moves[i].endPos())) {
+					rules.undoMove();
+					continue;
+				}
+				LegalMoveSet reply;
+				reply.compute(rules);
+				rules.undoMove();
+
+				lock.lock();
+				bool stale = gen != generation;
+				if (!stale) speculative.push_back(reply);
+				lock.unlock();
+				if (stale) break;
+			}
+			lock.lock();
+		}
+	}
+
+public:
+	std::function<void()> onReady;	// Called on the worker thread when the result of a request is ready, if set
+
+	MoveWorker() : quit(false), hasJob(false), generation(0), pending(false), resultReady(false), speculativeHits(0) {};
+
+	~MoveWorker() {
+		if (!worker.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+
+	MoveWorker(const MoveWorker&) = delete;
+	MoveWorker& operator=(const MoveWorker&) = delete;
+
+	// Ask for the legal moves of the position of rules, which is copied. Any earlier request is dropped.
+	// Returns true with the moves in out if they were precomputed, else the worker starts on them and poll gets them.
+	bool request(const ChessRules& rules, LegalMoveSet& out) {
+		std::lock_guard<std::mutex> lock(mutex);
+		generation++;
+		job = rules;
+		hasJob = true;
+		resultReady = false;
+		pending = true;
+
+		// If it is known the worker only speculates from the position.
+		// The speculative positions are searched first, so a cache miss means neither had it.
+		UINT64 key = rules.positionKey();
+		for (const LegalMoveSet& s : speculative) {
+			if (s.key != key) continue;
+
+			out = s;
+			pending = false;
+			speculativeHits++;
+			cache.insert(s);
+			break;
+		}
+		if (pending && cache.find(key, out)) pending = false;
+		if (!pending) jobMoves = out;
+
+		if (!worker.joinable()) worker = std::thread([this]() { run(); });
+		wake.notify_all();
+		return !pending;
+	}
+
+	// Collect the result of the last request. Returns false if it is not ready or was collected already.
+	bool poll(LegalMoveSet& out) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!resultReady) return false;
+
+		out = result;
+		resultReady = false;
+		return true;
+	}
+
+	MoveWorkerStats stats() {
+		std::lock_guard<std::mutex> lock(mutex);
+		MoveWorkerStats s;
+		s.cacheHits = cache.hits;
+		s.cacheMisses = cache.misses;
+		s.speculativeHits = speculativeHits;
+		s.cached = cache.size();
+		return s;
+	}
+
+	// Wait for the result of the last request. Returns false if there is none pending.
+	bool wait(LegalMoveSet& out) {
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return resultReady || !pending; });
+		if (!resultReady) return false;
+
+		out = result;
+		resultReady = false;
+		return true;
+	}
+};
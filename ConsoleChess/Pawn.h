@@ -5,10 +5,30 @@
 
 class Pawn : public PieceDef
 {
+private:
+	UINT64 attackTable[2][64];	// Per team and target square: squares a pawn captures it from
+	UINT64 captureTable[2][64];	// Per team and square: squares a pawn on it captures
+
 public:
-	Pawn(byte id, Byte88 sprite) : PieceDef(id, false, sprite) { }
+	Pawn(byte id, Byte88 sprite) : PieceDef(id, false, sprite), attackTable{ }, captureTable{ } {
+		for (int t = 0; t < 2; t++) {
+			int dir = t ? -1 : 1;
+
+			for (int k = 0; k < 64; k++) {
+				IVec2 tgt = IVec2(k & 7, k >> 3);
 
-	bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) override {
+				for (int i = -1; i <= 1; i += 2) {
+					IVec2 from = tgt - IVec2(i, dir);
+					if (from.in88Square()) {
+						attackTable[t][k] |= SQUARE_BIT(POS_TO_INDEX(from));
+						captureTable[t][POS_TO_INDEX(from)] |= SQUARE_BIT(k);
+					}
+				}
+			}
+		}
+	}
+
+	bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) const override {
 		IVec2 delta = end - start;
 		Piece p = board.getPiece(start);
 		int dir = p.team ? -1 : 1;
@@ -35,17 +55,63 @@ public:
 		return false;
 	}
 
-	bool makeMove(IVec2 start, IVec2 end, BoardState& board) override {
+	void generateMoves(IVec2 start, const BoardState& board, MoveList& moves) const override {
+		Piece p = board.getPiece(start);
+		int dir = p.team ? -1 : 1;
+		int pos = POS_TO_INDEX(start);
+
+		if (start.y == (p.team ? 0 : 7)) return;
+
+		// Pushes
+		IVec2 one = start + IVec2(0, dir);
+		if (board[one] == 0) {
+			moves.add(pos, POS_TO_INDEX(one));
+
+			IVec2 two = one + IVec2(0, dir);
+			if (!p.moved && two.in88Square() && board[two] == 0) moves.add(pos, POS_TO_INDEX(two));
+		}
+		// Capture / en passant case
+		for (int i = -1; i <= 1; i += 2) {
+			IVec2 tgt = start + IVec2(i, dir);
+			if (!tgt.in88Square()) continue;
+
+			Piece cap = board.getPiece(tgt);
+			Piece enp = board.getPiece(start + IVec2(i, 0));
+
+			if ((cap.id != 0 && cap.team != p.team) ||
+				(cap.id == 0 && enp.team != p.team && enp.id == id && enp.spTemp == 1))
+				moves.add(pos, POS_TO_INDEX(tgt));
+		}
+	}
+
+	UINT64 attackers(IVec2 pos, bool team, const BoardState& board) const override {
+		return attackTable[team][POS_TO_INDEX(pos)] & board.pieces(id, team);
+	}
+
+	bool describesAttacks() const override {
+		return true;
+	}
+
+	UINT64 attacks(int pos, bool team, UINT64 occ) const override {
+		return captureTable[team][pos];
+	}
+
+	// En passant also removes the captured pawn
+	bool isPlainMove(IVec2 start, IVec2 end, const BoardState& board) const override {
+		return start.x == end.x || board[end] != 0;
+	}
+
+	bool makeMove(IVec2 start, IVec2 end, BoardState& board) const override {
 		IVec2 delta = end - start;
 		Piece p = board.getPiece(start);
 
 		if (delta.x != 0 && board[end] == 0) // En passant capture
-			board[start + IVec2(delta.x, 0)] = 0;
+			board.set(start + IVec2(delta.x, 0), 0);
 
-		board[end] = board[start] | PIECE_MOVED;
-		board[start] = 0;
+		board.set(end, board[start] | PIECE_MOVED);
+		board.set(start, 0);
 
-		if (abs(delta.y) > 1) board[end] |= PIECE_SPTEMP;
+		if (abs(delta.y) > 1) board.set(end, board[end] | PIECE_SPTEMP);
 
 		return end.y == 0 || end.y == 7;
 	}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Platform.h"
+#include "ChessRules.h"
+#include "StandardPieces.h"
+#include "Fen.h"
+
+// A legal move with its promotion choice (0 if the move does not promote)
+struct PerftMove {
+	IVec2 start;
+	IVec2 end;
+	byte promoteId;
+};
+
+// Performance test: counts the leaf nodes of the legal move tree of a position.
+// Drives the same generateLegalMoves / makeMove / undoMove path the game uses,
+// so it doubles as a throughput benchmark and a regression test for the rules.
+class Perft {
+private:
+	ChessRules& rules;
+
+public:
+	Perft(ChessRules& rules) : rules(rules) {};
+
+	// Collect the legal moves of the side to move. Promotions are expanded
+	// to one move per piece the game would offer in its promotion menu.
+	void generate(std::vector<PerftMove>& moves) {
+		MoveList legal;
+		rules.generateLegalMoves(rules.currTeam, legal);
+
+		for (int i = 0; i < legal.size; i++) {
+			IVec2 v = legal[i].startPos();
+			IVec2 u = legal[i].endPos();
+
+			if (rules.makeMove(v, u)) {
+				for (int id = 0; id < 16; id++) {
+					if (rules.canPromoteTo(u, id)) moves.push_back(PerftMove{ v, u, (byte)id });
+				}
+			}
+			else {
+				moves.push_back(PerftMove{ v, u, 0 });
+			}
+			rules.undoMove();
+		}
+	}
+
+	// Count the leaf nodes at the given depth.
+	UINT64 count(int depth) {
+		if (depth == 0) return 1;
+
+		std::vector<PerftMove> moves;
+		moves.reserve(64);
+		generate(moves);
+
+		// Bulk count: the leaves are the legal moves themselves
+		if (depth == 1) return moves.size();
+
+		UINT64 nodes = 0;
+		for (size_t i = 0; i < moves.size(); i++) {
+			nodes += countMove(moves[i], depth);
+		}
+
+		return nodes;
+	}
+
+	// Count the leaf nodes below a single move, at the given depth from the current position.
+	UINT64 countMove(const PerftMove& m, int depth) {
+		rules.makeMove(m.start, m.end);
+		if (m.promoteId != 0) rules.promote(m.end, m.promoteId);
+
+		UINT64 nodes = count(depth - 1);
+
+		rules.undoMove();
+		return nodes;
+	}
+
+	// Print the leaf count below every root move, then return the total.
+	UINT64 divide(int depth) {
+		std::vector<PerftMove> moves;
+		generate(moves);
+
+		UINT64 nodes = 0;
+		for (size_t i = 0; i < moves.size(); i++) {
+			UINT64 n = countMove(moves[i], depth);
+			printf("%s: %llu\n", moveName(moves[i].start, moves[i].end, moves[i].promoteId).c_str(), (unsigned long long)n);
+			nodes += n;
+		}
+		printf("\nMoves: %d\n", (int)moves.size());
+
+		return nodes;
+	}
+};
+
+// Entry point of the "perft" command line mode:
+//   perft <depth> [--divide] [--verify] [--dynamic] [--bench] [FEN]
+// Runs headlessly with the standard piece set, from the initial position if no FEN is given.
+// --dynamic uses the generic PieceDef path instead of the specialized standard set, and
+// --bench runs both and compares their times.
+int runPerft(int argc, char* argv[]) {
+	int depth = (argc > 0) ? atoi(argv[0]) : 0;
+	bool div = false;
+	bool verify = false;
+	bool dynamic = false;
+	bool bench = false;
+	std::string fen;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--divide") == 0) div = true;
+		else if (strcmp(argv[i], "--verify") == 0) verify = true;
+		else if (strcmp(argv[i], "--dynamic") == 0) dynamic = true;
+		else if (strcmp(argv[i], "--bench") == 0) bench = true;
+		else {
+			if (!fen.empty()) fen += ' ';
+			fen += argv[i];
+		}
+	}
+
+	if (depth < 1) {
+		printf("usage: perft <depth> [--divide] [--verify] [--dynamic] [--bench] [FEN]\n");
+		return 1;
+	}
+
+	StandardPieces set;
+	ChessRules rules = ChessRules(set.pieces());
+
+	if (!loadFen(fen.empty() ? FEN_START : fen.c_str(), rules)) {
+		printf("invalid FEN: %s\n", fen.c_str());
+		return 1;
+	}
+
+	rules.verifyKeys = verify;
+	rules.verifyMoves = verify;
+
+	if (bench) {
+		printf("Path      Nodes       Time (s)  NPS\n");
+		double secs[2];
+
+		for (int pass = 0; pass < 2; pass++) {
+			bool std = pass == 0 && rules.standardSet;
+			ChessRules r = rules;
+			r.standardSet = std;
+
+			auto start = std::chrono::steady_clock::now();
+			UINT64 nodes = Perft(r).count(depth);
+			secs[pass] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			printf("%-9s %-11llu %-9.3f %.0f\n", std ? "static" : "dynamic", (unsigned long long)nodes, secs[pass],
+				secs[pass] > 0 ? nodes / secs[pass] : 0.0);
+		}
+		printf("Speedup: %.2f\n", secs[0] > 0 ? secs[1] / secs[0] : 0.0);
+		return 0;
+	}
+
+	if (dynamic) rules.standardSet = false;
+	Perft perft = Perft(rules);
+	auto start = std::chrono::steady_clock::now();
+	UINT64 nodes = div ? perft.divide(depth) : perft.count(depth);
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Nodes: %llu\n", (unsigned long long)nodes);
+	printf("Time: %.3f s\n", secs);
+	printf("NPS: %.0f\n", secs > 0 ? nodes / secs : 0.0);
+	printf("Key: %016llx\n", (unsigned long long)rules.positionKey());
+	return 0;
+}
@@ -1,29 +1,83 @@
 #pragma once
 
 #include <vector>
-#include <Windows.h>
+#include "Platform.h"
 #include "IVec2.h"
 #include "BoardState.h"
 #include "Byte88.h"
+#include "MoveList.h"
 
 // Absract class for piece definitions. Will be inherited by the pieces to be added in the game.
+// The move methods are const and only touch the board they are given, so the definitions can be
+// shared by several threads, each searching its own copy of the position.
 class PieceDef {
 public:
 	byte id;
 	bool critical;
 	Byte88 sprite;
+	int value;	// Material value in centipawns, used by the engine's evaluation
+	byte standardId;	// Id of the same piece in StandardSet.h, 0 for any other piece
 
 	// Constructor
-	PieceDef() : id(0), critical(0), sprite() {};
-	PieceDef(byte id, bool critical, Byte88 sprite) : id(id), critical(critical), sprite(sprite) {};
+	PieceDef() : id(0), critical(0), sprite(), value(0), standardId(0) {};
+	PieceDef(byte id, bool critical, Byte88 sprite) : id(id), critical(critical), sprite(sprite), value(0), standardId(0) {};
 
-	virtual bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) {
+	virtual bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) const {
 		return false;
 	}
 
-	virtual bool makeMove(IVec2 start, IVec2 end, BoardState& board) {
-		board[end] = board[start] | PIECE_MOVED; // Set piece moved flag
-		board[start] = 0;
+	// Add the pseudolegal moves of the piece at start to the list.
+	// The default probes every square with isValidMove; subclasses enumerate their targets directly.
+	virtual void generateMoves(IVec2 start, const BoardState& board, MoveList& moves) const {
+		for (int i = 0; i < 64; i++) {
+			if (isValidMove(start, IVec2(i & 7, i >> 3), board)) moves.add(POS_TO_INDEX(start), i);
+		}
+	}
+
+	// Get the squares holding pieces of this type and the given team that attack pos,
+	// which is assumed to hold an enemy piece. Used for reverse attack queries (see ChessRules::isAttacked).
+	// The default asks isValidMove for every such piece; subclasses answer from precomputed tables.
+	virtual UINT64 attackers(IVec2 pos, bool team, const BoardState& board) const {
+		UINT64 res = 0;
+		UINT64 cand = board.pieces(id, team);
+
+		while (cand) {
+			int i = popLsb(cand);
+			if (isValidMove(IVec2(i & 7, i >> 3), pos, board)) res |= SQUARE_BIT(i);
+		}
+		return res;
+	}
+
+	// Attack description used by the pin-aware legal move generator (see ChessRules::generateLegalMoves).
+	// A piece returning true from describesAttacks() gives its attacked squares with attacks(), the
+	// directions it slides along until blocked with slideRays() (any other attack must not depend on
+	// the occupancy), and flags the moves changing more than start and end with isPlainMove().
+	// Positions with pieces that do not describe their attacks are checked by playing every move.
+	virtual bool describesAttacks() const {
+		return false;
+	}
+
+	// Squares attacked by a piece of the given team at pos, including the first blocker of sliding moves.
+	virtual UINT64 attacks(int pos, bool team, UINT64 occ) const {
+		return 0;
+	}
+
+	// Write the unit vectors the piece slides along into rays (at most 32) and return their count.
+	virtual int slideRays(IVec2* rays) const {
+		return 0;
+	}
+
+	// False if makeMove changes other squares than start and end for this move.
+	virtual bool isPlainMove(IVec2 start, IVec2 end, const BoardState& board) const {
+		return true;
+	}
+
+	// Perform a move on the board. Squares must be written with BoardState::set, and a move
+	// may change at most MAX_MOVE_CHANGES squares so that it can be undone.
+	// Return true if the moved piece must be promoted.
+	virtual bool makeMove(IVec2 start, IVec2 end, BoardState& board) const {
+		board.set(end, board[start] | PIECE_MOVED); // Set piece moved flag
+		board.set(start, 0);
 
 		return false;
 	}
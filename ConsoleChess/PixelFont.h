@@ -1,6 +1,6 @@
 #pragma once
 #include "Byte88.h"
-#include <Windows.h>
+#include "Platform.h"
 
 // Char stored as binary font; each bit is a pixel on/off
 // Made with simple enconding program using ConsoleEx drawSprite 
@@ -19,21 +19,21 @@ static const UINT64 PixelFont[96] {
 	0x0000000000000000,
 	0x0000000000000000,
 	0x0000000000000000,
+	0x0010107C10100000, // +
 	0x0000000000000000,
+	0x0000003800000000, // -
+	0x1000000000000000, // .
 	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
-	0x0000000000000000,
+	0x38444C5464443800, // 0
+	0x3810101010181000, // 1
+	0x7C08102040443800, // 2
+	0x3844403040443800, // 3
+	0x20207C2428302000, // 4
+	0x384440403C047C00, // 5
+	0x3844443C04083000, // 6
+	0x0808081020407C00, // 7
+	0x3844443844443800, // 8
+	0x1820407844443800, // 9
 	0x0018180018180000, // :
 	0x0000000000000000,
 	0x0000000000000000,
@@ -108,6 +108,9 @@ static const UINT64 PixelFont[96] {
 
 // Get a sprite representing a certain character from the PixelFont.
 Byte88 getCharSprite(char chr, byte bgCol, byte fillCol, byte outlineCol) {
+	// Lowercase letters use the uppercase glyphs
+	if (chr >= 'a' && chr <= 'z') chr -= 'a' - 'A';
+
 	// Check if char is in standard printable ASCII range
 	if (chr >= 32 && chr < 128) {
 		Byte88 sprite = Byte88(PixelFont[chr - 32], bgCol, fillCol);
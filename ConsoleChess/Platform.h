@@ -0,0 +1,79 @@
+#pragma once
+
+// Small portability layer for the rules code (boards, pieces, move generation) and the game UI.
+// On Windows everything comes from Windows.h; elsewhere we only define the few
+// names the headers rely on, so the headless tools (and headless rendering) can build on Linux.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cstddef>
+#include <cstdint>
+
+typedef unsigned char byte;
+typedef uint64_t UINT64;
+typedef uint32_t COLORREF;	// 0x00BBGGRR
+
+// Bounds-checked memcpy, mirrors the MSVC CRT signature.
+inline int memcpy_s(void* dest, size_t destSize, const void* src, size_t count) {
+	if (count > destSize) return -1;
+	memcpy(dest, src, count);
+	return 0;
+}
+
+// fopen with the MSVC CRT signature, which the /sdl build requires over fopen. Returns 0 on success.
+inline int fopen_s(FILE** file, const char* path, const char* mode) {
+	*file = fopen(path, mode);
+	return (*file == NULL) ? errno : 0;
+}
+
+// Windows.h defines min and max as macros, which the UI code uses unqualified
+using std::min;
+using std::max;
+
+// Console input records, so the game UI can be driven without a console
+typedef uint32_t DWORD;
+typedef uint16_t WORD;
+typedef int16_t SHORT;
+typedef int BOOL;
+
+#define INFINITE 0xFFFFFFFF
+#define MOUSE_MOVED 0x0001
+#define RI_MOUSE_BUTTON_1_DOWN 0x0001
+
+struct COORD { SHORT X; SHORT Y; };
+struct KEY_EVENT_RECORD { BOOL bKeyDown; WORD wRepeatCount; WORD wVirtualKeyCode; WORD wVirtualScanCode; union { wchar_t UnicodeChar; char AsciiChar; } uChar; DWORD dwControlKeyState; };
+struct MOUSE_EVENT_RECORD { COORD dwMousePosition; DWORD dwButtonState; DWORD dwControlKeyState; DWORD dwEventFlags; };
+struct MENU_EVENT_RECORD { unsigned int dwCommandId; };
+struct FOCUS_EVENT_RECORD { BOOL bSetFocus; };
+struct WINDOW_BUFFER_SIZE_RECORD { COORD dwSize; };
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Allocate size bytes aligned to align (a power of two, at least sizeof(void*)); release with alignedFree.
+// Returns NULL if the allocation fails.
+inline void* alignedAlloc(size_t size, size_t align) {
+#ifdef _WIN32
+	return _aligned_malloc(size, align);
+#else
+	void* p = NULL;
+	return posix_memalign(&p, align, size) == 0 ? p : NULL;
+#endif
+}
+
+inline void alignedFree(void* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ChessGame.h"
+#include "FramebufferOutput.h"
+#include "StandardPieces.h"
+
+// Save the window image to a .png or .ppm file
+bool saveFrame(const FramebufferOutput& frame, const char* path, int scale) {
+	size_t len = strlen(path);
+	bool png = len > 4 && strcmp(path + len - 4, ".png") == 0;
+	return png ? frame.writePNG(path, scale) : frame.writePPM(path, scale);
+}
+
+// Render a position through the game's own redraw and compositor into an image, without a console.
+// Usage: render [--out <file.ppm|file.png>] [--scale <n>] [--select <square>] [--hover <square>] [FEN]
+int runRender(int argc, char* argv[]) {
+	const char* out = "board.ppm";
+	int scale = 8;
+	const char* select = NULL;
+	const char* hover = NULL;
+	std::string fen;
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out = argv[++i];
+		else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) scale = (std::max)(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--select") == 0 && i + 1 < argc) select = argv[++i];
+		else if (strcmp(argv[i], "--hover") == 0 && i + 1 < argc) hover = argv[++i];
+		else {
+			if (!fen.empty()) fen += ' ';
+			fen += argv[i];
+		}
+	}
+
+	StandardPieces set;
+	ChessGame game(set.pieces(), StandardPieces::startingBoard());
+	FramebufferOutput* frame = new FramebufferOutput();
+	game.setOutput(frame);
+
+	if (!game.loadPosition(fen.empty() ? FEN_START : fen.c_str())) {
+		printf("invalid FEN: %s\n", fen.c_str());
+		return 1;
+	}
+	game.awaitMoves();
+
+	// Squares are given like e2; the events are sent to the middle of the square, as mouse input would be
+	const char* squares[2] = { select, hover };
+	for (int i = 0; i < 2; i++) {
+		const char* sq = squares[i];
+		if (sq == NULL) continue;
+
+		if (strlen(sq) != 2 || sq[0] < 'a' || sq[0] > 'h' || sq[1] < '1' || sq[1] > '8') {
+			printf("invalid square: %s\n", sq);
+			return 1;
+		}
+		MOUSE_EVENT_RECORD evt = MOUSE_EVENT_RECORD();
+		evt.dwMousePosition.X = (sq[0] - 'a') * 8 + 4;
+		evt.dwMousePosition.Y = ('8' - sq[1]) * 8 + 4;
+		if (i == 0) evt.dwButtonState = RI_MOUSE_BUTTON_1_DOWN;
+		else evt.dwEventFlags = MOUSE_MOVED;
+		game.onMouse(evt);
+	}
+	game.awaitMoves();
+	game.flush();
+
+	if (!saveFrame(*frame, out, scale)) {
+		printf("cannot write %s\n", out);
+		return 1;
+	}
+	printf("%s: %dx%d, %d frames, %d cells in the last\n", out, frame->width() * scale, frame->height() * scale, frame->frames, frame->lastCells);
+	return 0;
+}
+
+// Play back an input recording through the game without a console, and time each frame that showed input
+// from the first event it shows to the end of its invalidate. Without --realtime the events are replayed
+// as fast as possible. Redraws are limited to --fps per second (default 60, 0 for no limit).
+// Usage: replay <file> [--realtime] [--fps <n>] [--out <file.ppm|file.png>] [--scale <n>]
+int runReplay(int argc, char* argv[]) {
+	const char* path = NULL;
+	const char* out = NULL;
+	int scale = 8;
+	int fps = 60;
+	bool realtime = false;
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--realtime") == 0) realtime = true;
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) fps = (std::max)(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out = argv[++i];
+		else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) scale = (std::max)(1, atoi(argv[++i]));
+		else path = argv[i];
+	}
+	if (path == NULL) {
+		printf("usage: replay <file> [--realtime] [--fps <n>] [--out <file.ppm|file.png>] [--scale <n>]\n");
+		return 1;
+	}
+
+	StandardPieces set;
+	ChessGame game(set.pieces(), StandardPieces::startingBoard());
+	FramebufferOutput* frame = new FramebufferOutput();
+	game.setOutput(frame);
+	game.setFrameRate(fps);
+	game.beginGame();
+	game.awaitMoves();
+	game.flush();
+
+	if (!game.replayInput(path, realtime)) {
+		printf("cannot read recording %s\n", path);
+		return 1;
+	}
+
+	std::vector<double> frameUs;
+	auto start = std::chrono::steady_clock::now();
+	while (game.replayingInput()) {
+		size_t frames = game.inputFrames();
+		game.tick();
+		if (game.inputFrames() != frames) frameUs.push_back(game.inputLatencyUs());
+	}
+	size_t frames = game.inputFrames();
+	game.awaitMoves();
+	game.flush();
+	if (game.inputFrames() != frames) frameUs.push_back(game.inputLatencyUs());
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double total = 0, worst = 0;
+	for (double us : frameUs) {
+		total += us;
+		worst = (std::max)(worst, us);
+	}
+	printf("replayed %d events in %.3f s (%d mouse moves coalesced), %d frames showed input: latency mean %.1f us, max %.1f us\n",
+		(int)(game.inputEvents() + game.coalescedMoves()), secs, (int)game.coalescedMoves(), (int)frameUs.size(),
+		frameUs.empty() ? 0.0 : total / frameUs.size(), worst);
+
+	if (out != NULL && !saveFrame(*frame, out, scale)) {
+		printf("cannot write %s\n", out);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,386 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "Platform.h"
+#include "ChessRules.h"
+#include "TranspositionTable.h"
+
+// Deepest ply the search (including quiescence) may reach
+#define MAX_PLY 64
+// Score of a checkmate at the root; mates further away score MATE_SCORE - ply
+#define MATE_SCORE 100000
+// Scores beyond this are mates
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)
+
+// A move as played by the engine, with its promotion choice (0 if the move does not promote)
+struct SearchMove {
+	Move move;
+	byte promoteId;
+
+	bool operator==(const SearchMove& m) const {
+		return move.start == m.move.start && move.end == m.move.end && promoteId == m.promoteId;
+	}
+};
+
+// Limits of a search. The search stops at whichever is reached first; 0 means no limit.
+struct SearchLimits {
+	int depth;
+	int timeMs;
+	UINT64 nodes;
+
+	SearchLimits() : depth(MAX_PLY - 1), timeMs(1000), nodes(0) {};
+};
+
+// Progress of a search, reported after every completed iteration.
+struct SearchInfo {
+	int depth;
+	int score;	// From the point of view of the side to move
+	UINT64 nodes;
+	double secs;
+	std::vector<SearchMove> pv;	// Best line
+
+	SearchInfo() : depth(0), score(0), nodes(0), secs(0) {};
+
+	double nps() const { return secs > 0 ? nodes / secs : 0.0; }
+};
+
+// State shared by the threads searching the same position (Lazy SMP)
+struct SearchShared {
+	std::atomic<bool> stop;		// Set to abort all threads
+	std::atomic<UINT64> nodes;	// Nodes of all threads, added in batches of 1024
+	TranspositionTable* tt;		// May be NULL
+
+	SearchShared() : stop(false), nodes(0), tt(NULL) {};
+};
+
+// Bonus per square for piece centralization, in centipawns
+static const int CenterBonus[64] = {
+	0, 1, 2, 3, 3, 2, 1, 0,
+	1, 4, 5, 6, 6, 5, 4, 1,
+	2, 5, 8, 9, 9, 8, 5, 2,
+	3, 6, 9, 12, 12, 9, 6, 3,
+	3, 6, 9, 12, 12, 9, 6, 3,
+	2, 5, 8, 9, 9, 8, 5, 2,
+	1, 4, 5, 6, 6, 5, 4, 1,
+	0, 1, 2, 3, 3, 2, 1, 0
+};
+
+// Negamax alpha-beta search with iterative deepening and a capture quiescence search.
+// Works on its own copy of the rules, so it can run on a worker thread while the game
+// keeps its position. Moves are generated by the piece definitions, so fairy piece sets
+// are searched too; the evaluation uses PieceDef::value and centralization.
+// Several searches of the same position can run in parallel sharing a SearchShared; the helper
+// threads (threadId > 0) vary their depths and move order and only feed the transposition table.
+class Search {
+private:
+	ChessRules rules;
+	SearchLimits limits;
+	SearchShared* shared;	// May be NULL for a single thread search without a table
+	TranspositionTable* tt;
+	int threadId;
+
+	UINT64 nodes;
+	int rootDepth;
+	bool stopped;
+	std::chrono::steady_clock::time_point startTime;
+
+	SearchMove pv[MAX_PLY][MAX_PLY];	// Triangular PV table
+	int pvLength[MAX_PLY];
+	std::vector<SearchMove> prevPv;	// Best line of the previous iteration, searched first
+	bool followPv;
+
+	double elapsed() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	}
+
+	// Nodes searched by all threads
+	UINT64 totalNodes() const {
+		return shared != NULL ? shared->nodes.load(std::memory_order_relaxed) + (nodes & 1023) : nodes;
+	}
+
+	// Publish the node count, and poll the clock and the stop flag every 1024 nodes; stop on the node limit at once.
+	// The first iteration always completes (unless stopped from outside), so there is a move to play.
+	void checkLimits() {
+		if ((nodes & 1023) == 0) {
+			if (shared != NULL) {
+				shared->nodes.fetch_add(1024, std::memory_order_relaxed);
+				if (shared->stop.load(std::memory_order_relaxed)) stopped = true;
+			}
+			if (rootDepth > 1 && limits.timeMs && elapsed() * 1000 >= limits.timeMs) stopped = true;
+		}
+		if (rootDepth > 1 && limits.nodes && totalNodes() >= limits.nodes) stopped = true;
+	}
+
+	// Mate scores are stored relative to the node, so they stay valid at other plies
+	static int scoreToTT(int score, int ply) {
+		return score >= MATE_BOUND ? score + ply : score <= -MATE_BOUND ? score - ply : score;
+	}
+
+	static int scoreFromTT(int score, int ply) {
+		return score >= MATE_BOUND ? score - ply : score <= -MATE_BOUND ? score + ply : score;
+	}
+
+	int value(byte b) const {
+		const PieceDef* def = rules.pieceDefs[b & PIECE_ID];
+		return def != NULL ? def->value : 0;
+	}
+
+	// Static evaluation from the point of view of the side to move.
+	int evaluate() const {
+		int score = 0;
+
+		for (int t = 0; t < 2; t++) {
+			int sign = t ? 1 : -1;
+			UINT64 own = rules.board.teamBB[t];
+
+			while (own) {
+				int i = popLsb(own);
+				const PieceDef* def = rules.pieceDefs[rules.board[i] & PIECE_ID];
+
+				score += sign * def->value;
+				if (!def->critical) score += sign * CenterBonus[i];
+			}
+		}
+		return rules.currTeam ? score : -score;
+	}
+
+	// Order key of a move: the table move and the previous best line first, then captures by
+	// most valuable victim / least valuable attacker. Helper threads shuffle the quiet moves.
+	int orderScore(const Move& m, Move ttMove, int ply) const {
+		if (m.start == ttMove.start && m.end == ttMove.end) return 1 << 30;
+		if (followPv && ply < (int)prevPv.size() && prevPv[ply].move.start == m.start && prevPv[ply].move.end == m.end)
+			return 1 << 29;
+
+		byte victim = rules.board[m.end];
+		if (victim == 0) return threadId ? ((m.start * 37 + m.end * 11) ^ threadId * 29) & 63 : 0;
+
+		return 16 * value(victim) - value(rules.board[m.start]) + (1 << 20);
+	}
+
+	// Sort the moves by order key, best first.
+	void orderMoves(MoveList& moves, int ply, Move ttMove = Move{ 0, 0 }) const {
+		int scores[MAX_MOVES];
+		for (int i = 0; i < moves.size; i++) scores[i] = orderScore(moves[i], ttMove, ply);
+
+		for (int i = 1; i < moves.size; i++) {
+			Move m = moves[i];
+			int s = scores[i];
+			int j = i - 1;
+
+			for (; j >= 0 && scores[j] < s; j--) {
+				moves[j + 1] = moves[j];
+				scores[j + 1] = scores[j];
+			}
+			moves[j + 1] = m;
+			scores[j + 1] = s;
+		}
+	}
+
+	// Most valuable piece the piece at pos may promote to (0 if none).
+	byte bestPromotion(IVec2 pos) const {
+		byte best = 0;
+
+		for (int id = 1; id < 16; id++) {
+			if (rules.canPromoteTo(pos, id) && (best == 0 || rules.pieceDefs[id]->value > rules.pieceDefs[best]->value))
+				best = id;
+		}
+		return best;
+	}
+
+	void updatePv(int ply, const SearchMove& m) {
+		pv[ply][ply] = m;
+		for (int i = ply + 1; i < pvLength[ply + 1]; i++) pv[ply][i] = pv[ply + 1][i];
+		pvLength[ply] = pvLength[ply + 1];
+	}
+
+	// Search captures only, until the position is quiet.
+	int quiesce(int ply, int alpha, int beta) {
+		nodes++;
+		checkLimits();
+		pvLength[ply] = ply;
+		if (stopped) return 0;
+
+		int standPat = evaluate();
+		if (ply >= MAX_PLY - 1 || standPat >= beta) return standPat;
+		if (standPat > alpha) alpha = standPat;
+
+		bool team = rules.currTeam;
+		MoveList moves;
+		rules.generatePseudoMoves(team, moves);
+
+		// Keep the captures
+		int n = 0;
+		for (int i = 0; i < moves.size; i++) {
+			if (rules.board.teamBB[!team] & SQUARE_BIT(moves[i].end)) moves[n++] = moves[i];
+		}
+		moves.size = n;
+		orderMoves(moves, ply);
+
+		for (int i = 0; i < moves.size; i++) {
+			SearchMove m = SearchMove{ moves[i], 0 };
+
+			if (rules.makeMove(m.move.startPos(), m.move.endPos())) {
+				m.promoteId = bestPromotion(m.move.endPos());
+				if (m.promoteId != 0) rules.promote(m.move.endPos(), m.promoteId);
+			}
+			if (rules.inCheck(team)) {
+				rules.undoMove();
+				continue;
+			}
+
+			int score = -quiesce(ply + 1, -beta, -alpha);
+			rules.undoMove();
+
+			if (stopped) return 0;
+			if (score >= beta) return score;
+			if (score > alpha) {
+				alpha = score;
+				updatePv(ply, m);
+			}
+		}
+		return alpha;
+	}
+
+	// Score a move that was just made, trying its promotions if it promotes.
+	// Pseudolegal moves leaving a critical piece attacked are skipped (return false).
+	bool searchMove(SearchMove m, bool promote, int depth, int ply, int& alpha, int beta) {
+		bool team = !rules.currTeam;
+
+		if (rules.inCheck(team)) return false;
+		if (promote && bestPromotion(m.move.endPos()) == 0) promote = false;
+
+		// Each promotion choice is searched as its own move; promoting again replaces the previous choice
+		for (int id = promote ? 1 : 0; id < (promote ? 16 : 1); id++) {
+			if (promote) {
+				if (!rules.canPromoteTo(m.move.endPos(), id)) continue;
+				rules.promote(m.move.endPos(), id);
+				m.promoteId = id;
+			}
+
+			int score = -negamax(depth - 1, ply + 1, -beta, -alpha);
+			if (stopped) return true;
+
+			if (score > alpha) {
+				alpha = score;
+				updatePv(ply, m);
+				if (alpha >= beta) return true;
+			}
+		}
+		return true;
+	}
+
+	int negamax(int depth, int ply, int alpha, int beta) {
+		if (depth <= 0 || ply >= MAX_PLY - 1) return quiesce(ply, alpha, beta);
+
+		nodes++;
+		checkLimits();
+		pvLength[ply] = ply;
+		if (stopped) return 0;
+
+		// Table lookup: a deep enough result ends the search of this node, else its move is tried first
+		UINT64 key = rules.positionKey();
+		Move ttMove = Move{ 0, 0 };
+		TTData entry;
+
+		if (tt != NULL && tt->probe(key, entry)) {
+			ttMove = Move{ entry.start, entry.end };
+
+			if (ply > 0 && entry.depth >= depth) {
+				int score = scoreFromTT(entry.score, ply);
+
+				if (entry.bound == BoundExact) return (std::max)(alpha, (std::min)(beta, score));
+				if (entry.bound == BoundLower && score >= beta) return beta;
+				if (entry.bound == BoundUpper && score <= alpha) return alpha;
+			}
+		}
+
+		bool team = rules.currTeam;
+		MoveList moves;
+		rules.generatePseudoMoves(team, moves);
+		orderMoves(moves, ply, ttMove);
+
+		// The previous best line only guides the first branch at each ply
+		if (followPv && (ply >= (int)prevPv.size() || moves.size == 0 ||
+			prevPv[ply].move.start != moves[0].start || prevPv[ply].move.end != moves[0].end))
+			followPv = false;
+
+		int legal = 0;
+		int oldAlpha = alpha;
+		SearchMove best = SearchMove{ Move{ 0, 0 }, 0 };
+
+		for (int i = 0; i < moves.size && alpha < beta; i++) {
+			SearchMove m = SearchMove{ moves[i], 0 };
+			bool promote = rules.makeMove(m.move.startPos(), m.move.endPos());
+			int prev = alpha;
+
+			if (searchMove(m, promote, depth, ply, alpha, beta)) legal++;
+			rules.undoMove();
+			followPv = false;
+
+			if (stopped) return 0;
+			if (alpha > prev) best = pv[ply][ply];
+		}
+
+		// No legal move: checkmate or stalemate
+		if (legal == 0) alpha = rules.inCheck(team) ? -MATE_SCORE + ply : 0;
+
+		if (tt != NULL) {
+			TTBound bound = alpha >= beta ? BoundLower : alpha > oldAlpha ? BoundExact : BoundUpper;
+			tt->store(key, TTData{ scoreToTT(alpha, ply), best.move.start, best.move.end, best.promoteId, depth, bound });
+		}
+		return alpha;
+	}
+
+public:
+	// Called after every completed iteration
+	std::function<void(const SearchInfo&)> onInfo;
+
+	Search(const ChessRules& rules, SearchShared* shared = NULL, int threadId = 0) : rules(rules), shared(shared),
+		tt(shared != NULL ? shared->tt : NULL), threadId(threadId), nodes(0), rootDepth(0), stopped(false), pvLength{ }, followPv(false), onInfo(NULL) {
+		this->rules.verifyKeys = false;
+	};
+
+	// Search the position by iterative deepening until a limit is reached.
+	// Return the best line of the deepest completed iteration (empty if there is no legal move).
+	SearchInfo run(const SearchLimits& limits) {
+		this->limits = limits;
+		nodes = 0;
+		stopped = false;
+		prevPv.clear();
+		startTime = std::chrono::steady_clock::now();
+
+		SearchInfo info;
+
+		// Odd helper threads start one ply deeper, so the threads spread over two depths
+		for (int depth = 1 + (threadId & 1); depth <= limits.depth && depth < MAX_PLY; depth++) {
+			rootDepth = depth;
+			followPv = true;
+			int score = negamax(depth, 0, -MATE_SCORE - 1, MATE_SCORE + 1);
+
+			// An interrupted iteration is discarded
+			if (stopped) break;
+
+			info.depth = depth;
+			info.score = score;
+			info.nodes = totalNodes();
+			info.secs = elapsed();
+			info.pv.assign(pv[0], pv[0] + pvLength[0]);
+			prevPv = info.pv;
+
+			if (onInfo != NULL) onInfo(info);
+
+			// Stop on a found mate, on no legal moves, or when the next iteration cannot finish in time
+			if (info.pv.empty() || abs(score) >= MATE_BOUND) break;
+			if (limits.timeMs && elapsed() * 1000 * 2 >= limits.timeMs) break;
+		}
+
+		if (shared != NULL) info.nodes = shared->nodes.fetch_add(nodes & 1023, std::memory_order_relaxed) + (nodes & 1023);
+		else info.nodes = nodes;
+
+		info.secs = elapsed();
+		return info;
+	}
+};
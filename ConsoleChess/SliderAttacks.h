@@ -0,0 +1,259 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include "Platform.h"
+#include "IVec2.h"
+#include "Byte88.h"
+#include "Bitboard.h"
+
+// BMI2 (PEXT) support is only compiled for x86-64 and selected at runtime.
+// Define SLIDER_NO_PEXT to always use magic multiplies.
+#if defined(SLIDER_NO_PEXT)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <immintrin.h>
+#define SLIDER_HAS_PEXT
+#define SLIDER_PEXT_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#define SLIDER_HAS_PEXT
+#define SLIDER_PEXT_TARGET __attribute__((target("bmi2")))
+#endif
+
+// True if the CPU supports the BMI2 instruction set.
+inline bool cpuHasBmi2() {
+#if defined(SLIDER_HAS_PEXT) && defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, 7, 0);
+	return (info[1] >> 8) & 1;
+#elif defined(SLIDER_HAS_PEXT)
+	unsigned int a, b, c, d;
+	if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+	return (b >> 8) & 1;
+#else
+	return false;
+#endif
+}
+
+#ifdef SLIDER_HAS_PEXT
+SLIDER_PEXT_TARGET inline UINT64 pextIndex(UINT64 occ, UINT64 mask) {
+	return _pext_u64(occ, mask);
+}
+#endif
+
+// Maximum number of occupancy bits per table lookup (4096 entries, as for a rook)
+#define SLIDER_MAX_BITS 12
+// Maximum number of lookups per square (ray groups)
+#define SLIDER_MAX_GROUPS 16
+
+// Magics for the standard rook and bishop masks, per square. They are tried first,
+// so the common pieces skip the random search; other movesets search their own.
+static const UINT64 RookMagics[64] = {
+	0x0A80008010400020, 0x184000431004E004, 0x2080100020000880, 0x0900100088210004,
+	0x3001002080084010, 0x0800844010020820, 0x040004091A008810, 0x02000A0040208504,
+	0x0009800080400030, 0x1000401000402000, 0x5002001020420088, 0x00D0800800801001,
+	0x3200808004000800, 0x0812000408100200, 0x8016000834120001, 0x200180208000C100,
+	0x0018208000400082, 0x2028404010082000, 0x4000808010002000, 0x0A04090010022100,
+	0x0280110008010004, 0x4104008004020080, 0x0601040010010882, 0x2003020011006884,
+	0x009264808000400A, 0x8070500040002000, 0x0000200480100080, 0x0059000900100122,
+	0x0008008880040080, 0xC020100801400420, 0x004401040002C810, 0x6041008200084C29,
+	0x8480002010400040, 0x0081008202002048, 0x2A0D0250C1002002, 0x8800800802801002,
+	0x2008002004040040, 0x0000800200800400, 0x0400080204000110, 0x0883000081000062,
+	0x0060400080088020, 0x0240008020008040, 0x2020420014820020, 0x0000100008008080,
+	0x0008020004004040, 0x0022000410020008, 0x0B00010002008080, 0x240C092040820014,
+	0x0941008042002A00, 0x90C020401D008100, 0x0124481020010500, 0x0000800801100180,
+	0x190008010124D100, 0x0202001008142600, 0x0901000E00040500, 0x0E00405415009200,
+	0x1042052100418216, 0x0001001042022282, 0x0001082001001241, 0x1000040900201001,
+	0x0421000410020801, 0x8802004490080102, 0x2010010082083004, 0x04000C042089C902,
+};
+
+static const UINT64 BishopMagics[64] = {
+	0x0208308128002080, 0x880A0A040C0C8000, 0x0808408102080440, 0x0004041080400A08,
+	0x002410A800042001, 0x0122080A08600000, 0x0004046412080000, 0x0081008800861020,
+	0x0040410801440088, 0x0040080200860210, 0x0000181204002200, 0x0002280A002002E0,
+	0x00800404A0000028, 0xB000390908406821, 0x2040022A01044010, 0x1101810088040305,
+	0x00C0A10438060402, 0x0008000401080200, 0x8051001005082102, 0x0808001220809000,
+	0x800C048080A02010, 0x0020200A00900874, 0x00310010C8088420, 0x4A22410034040420,
+	0x0002408208100444, 0xE0CA282020280089, 0x8400480004002400, 0x0101004024040102,
+	0x1012040082008200, 0x8030088098405020, 0x40030A441C12080C, 0x060200200200823A,
+	0x0046104020100310, 0x00182C10D2022200, 0x0002015700900101, 0x8011202020080080,
+	0x20220A04000A0082, 0x1210020200002080, 0x4014081222004108, 0x0360808080020600,
+	0x0004041308004004, 0x0001131860000209, 0x0102026201000802, 0x0400224010420A00,
+	0x1052082008201100, 0x4420222042002640, 0x9108103280902200, 0x010801A10200C040,
+	0x0900880110100002, 0x00808A0846020000, 0xC230442205500288, 0x1000040084040000,
+	0x0200041002020088, 0x8402C01801610000, 0x0006888208020100, 0x0202300240950050,
+	0x0010240101B01024, 0x01000920882C3000, 0x0030880260841006, 0x0060102040420210,
+	0x0000044884050402, 0x000A001102101100, 0x080008024404540A, 0x0014010204040081,
+};
+
+// Occupancy-indexed attack tables for a set of sliding directions (unit vectors repeated
+// until blocked). The rays are packed into groups of at most SLIDER_MAX_BITS relevant squares,
+// so a rook or bishop is one table load and a queen two. A group is indexed with PEXT when the
+// CPU supports BMI2, and with a magic multiply otherwise.
+class SliderTable {
+private:
+	struct Entry {
+		UINT64 mask;	// Relevant occupancy (ray squares except the last one of each ray)
+		UINT64 magic;
+		int shift;
+		size_t offset;	// Start of this entry's attacks in the table
+	};
+
+	std::vector<Entry> entries;	// Per square, nGroups entries
+	int nGroups;
+	bool pext;
+	std::vector<UINT64> table;
+
+	// Reference attack set along the given rays, walking square by square.
+	static UINT64 walkAttacks(int sq, UINT64 occ, const IVec2* dirs, int nDirs) {
+		UINT64 res = 0;
+
+		for (int r = 0; r < nDirs; r++) {
+			for (IVec2 v = IVec2(sq & 7, sq >> 3) + dirs[r]; v.in88Square(); v += dirs[r]) {
+				UINT64 bit = SQUARE_BIT(POS_TO_INDEX(v));
+				res |= bit;
+				if (occ & bit) break;
+			}
+		}
+		return res;
+	}
+
+	// Squares whose occupancy matters along the given rays.
+	static UINT64 relevantMask(int sq, const IVec2* dirs, int nDirs) {
+		UINT64 res = 0;
+
+		for (int r = 0; r < nDirs; r++) {
+			for (IVec2 v = IVec2(sq & 7, sq >> 3) + dirs[r]; (v + dirs[r]).in88Square(); v += dirs[r]) {
+				res |= SQUARE_BIT(POS_TO_INDEX(v));
+			}
+		}
+		return res;
+	}
+
+	static UINT64 nextRandom(UINT64& state) {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 2685821657736338717ULL;
+	}
+
+	UINT64 index(const Entry& e, UINT64 occ) const {
+#ifdef SLIDER_HAS_PEXT
+		if (pext) return pextIndex(occ, e.mask);
+#endif
+		return ((occ & e.mask) * e.magic) >> e.shift;
+	}
+
+	// Fill the attacks of one square and ray group, searching a magic if PEXT is not used.
+	void buildEntry(int sq, Entry& e, const IVec2* dirs, int nDirs, UINT64& seed) {
+		int bits = popcount(e.mask);
+		size_t n = (size_t)1 << bits;
+		std::vector<UINT64> occs(n), atts(n);
+
+		// Enumerate all subsets of the mask (carry-rippler)
+		UINT64 occ = 0;
+		for (size_t i = 0; i < n; i++) {
+			occs[i] = occ;
+			atts[i] = walkAttacks(sq, occ, dirs, nDirs);
+			occ = (occ - e.mask) & e.mask;
+		}
+
+		e.offset = table.size();
+		table.resize(e.offset + n);
+		UINT64* att = &table[e.offset];
+
+		// An empty mask has a single entry; keep the shift defined
+		e.shift = bits ? 64 - bits : 63;
+		e.magic = 0;
+
+		if (pext || bits == 0) {
+			for (size_t i = 0; i < n; i++) att[index(e, occs[i])] = atts[i];
+			return;
+		}
+
+		// Try the known magics, then sparse random ones, until every occupancy
+		// maps to a slot holding its attacks
+		std::vector<int> epoch(n);
+		for (int attempt = 1; ; attempt++) {
+			if (attempt == 1) e.magic = RookMagics[sq];
+			else if (attempt == 2) e.magic = BishopMagics[sq];
+			else {
+				e.magic = nextRandom(seed) & nextRandom(seed) & nextRandom(seed);
+				// Cheap filter: good magics spread the mask into the top index bits
+				if (bits >= 8 && popcount((e.mask * e.magic) >> 56) < 6) continue;
+			}
+			bool ok = true;
+
+			for (size_t i = 0; ok && i < n; i++) {
+				UINT64 idx = index(e, occs[i]);
+
+				if (epoch[idx] != attempt) { epoch[idx] = attempt; att[idx] = atts[i]; }
+				else if (att[idx] != atts[i]) ok = false;
+			}
+			if (ok) return;
+		}
+	}
+
+public:
+	SliderTable() : nGroups(0), pext(false) {};
+
+	// True if the table uses PEXT indexing.
+	bool usesPext() const { return pext; }
+
+	// Build the tables for the given ray directions. Throws if they need more than SLIDER_MAX_GROUPS lookups.
+	void build(const IVec2* dirs, int nDirs) {
+		pext = cpuHasBmi2();
+		table.clear();
+		entries.clear();
+		nGroups = 0;
+
+		// Pack rays into groups, keeping each group within SLIDER_MAX_BITS on every square
+		IVec2 groups[SLIDER_MAX_GROUPS][32];
+		int groupSize[SLIDER_MAX_GROUPS] = { };
+
+		for (int r = 0; r < nDirs; r++) {
+			int g = 0;
+			for (; g < nGroups; g++) {
+				groups[g][groupSize[g]] = dirs[r];
+				bool fits = true;
+
+				for (int sq = 0; fits && sq < 64; sq++) {
+					fits = popcount(relevantMask(sq, groups[g], groupSize[g] + 1)) <= SLIDER_MAX_BITS;
+				}
+				if (fits) break;
+			}
+			if (g == SLIDER_MAX_GROUPS) {
+				nGroups = 0;
+				throw std::runtime_error("Slider rays do not fit in SLIDER_MAX_GROUPS table lookups");
+			}
+			if (g == nGroups) nGroups++;
+			groups[g][groupSize[g]++] = dirs[r];
+		}
+
+		// Per-row PRNG seeds known to find chess magics quickly
+		static const UINT64 seeds[8] = { 1776, 1387, 1053, 2719, 2271, 2078, 974, 30 };
+
+		entries.assign(64 * nGroups, Entry());
+		for (int sq = 0; sq < 64; sq++) {
+			UINT64 seed = seeds[sq >> 3];
+
+			for (int g = 0; g < nGroups; g++) {
+				Entry& e = entries[sq * nGroups + g];
+				e.mask = relevantMask(sq, groups[g], groupSize[g]);
+				buildEntry(sq, e, groups[g], groupSize[g], seed);
+			}
+		}
+	}
+
+	// Squares attacked from sq along the rays, given the board occupancy. Includes the blockers.
+	UINT64 attacks(int sq, UINT64 occ) const {
+		UINT64 res = 0;
+
+		for (int g = 0; g < nGroups; g++) {
+			const Entry& e = entries[sq * nGroups + g];
+			res |= table[e.offset + index(e, occ)];
+		}
+		return res;
+	}
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include "Platform.h"
+#include "BoardState.h"
+#include "UnitMovePiece.h"
+#include "SpriteDefs.h"
+#include "Pawn.h"
+#include "King.h"
+#include "StandardSet.h"
+
+// Initial chess position, using the ids of the standard piece set below
+static const byte StandardStartPosition[64] = {
+	0x04, 0x03, 0x02, 0x05, 0x06, 0x02, 0x03, 0x04,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	0x14, 0x13, 0x12, 0x15, 0x16, 0x12, 0x13, 0x14
+};
+
+// The six standard chess pieces, shared by the game and the headless tools.
+// Holds the definitions by value, so it must outlive anything using pieces().
+struct StandardPieces {
+	Pawn pawn;
+	UnitMovePiece bishop;
+	UnitMovePiece knight;
+	UnitMovePiece rook;
+	UnitMovePiece queen;
+	King king;
+
+	StandardPieces() :
+		pawn(1, PawnSprite),
+		bishop(2, false, false, BishopSprite),
+		knight(3, false, true, KnightSprite),
+		rook(4, false, false, RookSprite),
+		queen(5, false, false, QueenSprite),
+		king(6, 4, KingSprite)
+	{
+		bishop.generateMoveset(std::vector<IVec2> {IVec2(1, 1)}, Rotate90, true);
+		knight.generateMoveset(std::vector<IVec2> {IVec2(2, 1)}, Rotate90 | FlipY, false);
+		rook.generateMoveset(std::vector<IVec2> {IVec2(1, 0)}, Rotate90, true);
+		queen.generateMoveset(std::vector<IVec2> {IVec2(1, 0)}, Rotate45, true);
+
+		pawn.value = 100;
+		bishop.value = 330;
+		knight.value = 320;
+		rook.value = 500;
+		queen.value = 900;
+
+		// Same ids as StandardSet.h, so ChessRules uses its specialized code
+		pawn.standardId = StdPawn;
+		bishop.standardId = StdBishop;
+		knight.standardId = StdKnight;
+		rook.standardId = StdRook;
+		queen.standardId = StdQueen;
+		king.standardId = StdKing;
+	}
+
+	StandardPieces(const StandardPieces&) = delete;
+	StandardPieces& operator=(const StandardPieces&) = delete;
+
+	// Create vector of PieceDef pointers
+	std::vector<PieceDef*> pieces() {
+		return std::vector<PieceDef*> { &pawn, &bishop, &knight, &rook, &queen, &king };
+	}
+
+	// Board state with the initial chess position
+	static BoardState startingBoard() {
+		return BoardState(StandardStartPosition);
+	}
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "Platform.h"
+#include "IVec2.h"
+#include "Bitboard.h"
+#include "BoardState.h"
+#include "MoveList.h"
+
+// Compile-time specialization of the standard piece set (see StandardPieces.h).
+// The attack tables are built by the compiler and the piece behaviour is selected with a switch
+// on the piece id, so ChessRules can generate and make moves of standard chess without virtual calls.
+// Must behave exactly like Pawn, King and the standard UnitMovePieces, including their move order.
+
+// Ids of the standard pieces
+enum StandardId : byte {
+	StdPawn = 1,
+	StdBishop = 2,
+	StdKnight = 3,
+	StdRook = 4,
+	StdQueen = 5,
+	StdKing = 6
+};
+
+// Slide directions. The first four step to higher board indices, the others to lower ones.
+enum StandardRay {
+	RayE, RayS, RaySE, RaySW,
+	RayW, RayN, RayNW, RayNE
+};
+
+// Precomputed attack tables of the standard pieces
+struct StandardTables {
+	UINT64 knight[64];	// Per square: the squares a knight reaches from it
+	UINT64 king[64];	// Per square: the squares one king step away
+	UINT64 pawnCaptures[2][64];		// Per team and square: squares a pawn on it captures
+	UINT64 pawnAttackers[2][64];	// Per team and target square: squares a pawn captures it from
+	UINT64 rays[8][64];	// Per direction and square: the squares up to the board edge
+
+	constexpr StandardTables() : knight(), king(), pawnCaptures(), pawnAttackers(), rays() {
+		const int rayX[8] = { 1, 0, 1, -1, -1, 0, -1, 1 };
+		const int rayY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+		const int leapX[8] = { 1, 2, 2, 1, -1, -2, -2, -1 };
+		const int leapY[8] = { 2, 1, -1, -2, -2, -1, 1, 2 };
+
+		for (int k = 0; k < 64; k++) {
+			int x = k & 7, y = k >> 3;
+
+			for (int d = 0; d < 8; d++) {
+				if (onBoard(x + leapX[d], y + leapY[d])) knight[k] |= SQUARE_BIT((y + leapY[d]) << 3 | (x + leapX[d]));
+				if (onBoard(x + rayX[d], y + rayY[d])) king[k] |= SQUARE_BIT((y + rayY[d]) << 3 | (x + rayX[d]));
+
+				for (int i = 1; onBoard(x + i * rayX[d], y + i * rayY[d]); i++) {
+					rays[d][k] |= SQUARE_BIT((y + i * rayY[d]) << 3 | (x + i * rayX[d]));
+				}
+			}
+
+			for (int t = 0; t < 2; t++) {
+				int dir = t ? -1 : 1;
+
+				for (int i = -1; i <= 1; i += 2) {
+					if (!onBoard(x + i, y + dir)) continue;
+
+					int tgt = (y + dir) << 3 | (x + i);
+					pawnCaptures[t][k] |= SQUARE_BIT(tgt);
+					pawnAttackers[t][tgt] |= SQUARE_BIT(k);
+				}
+			}
+		}
+	}
+
+	static constexpr bool onBoard(int x, int y) {
+		return x >= 0 && x < 8 && y >= 0 && y < 8;
+	}
+};
+
+static constexpr StandardTables StdTables = StandardTables();
+
+struct StandardSet {
+	// Squares along a direction up to and including the first piece of occ.
+	static UINT64 slide(int dir, int pos, UINT64 occ) {
+		UINT64 ray = StdTables.rays[dir][pos];
+		UINT64 blockers = ray & occ;
+
+		if (blockers) ray ^= StdTables.rays[dir][dir < RayW ? lsbIndex(blockers) : msbIndex(blockers)];
+		return ray;
+	}
+
+	static UINT64 rookAttacks(int pos, UINT64 occ) {
+		return slide(RayE, pos, occ) | slide(RayS, pos, occ) | slide(RayW, pos, occ) | slide(RayN, pos, occ);
+	}
+
+	static UINT64 bishopAttacks(int pos, UINT64 occ) {
+		return slide(RaySE, pos, occ) | slide(RaySW, pos, occ) | slide(RayNW, pos, occ) | slide(RayNE, pos, occ);
+	}
+
+	// Squares attacked by a piece of the given id and team at pos (PieceDef::attacks).
+	static UINT64 attacks(byte id, int pos, bool team, UINT64 occ) {
+		switch (id) {
+		case StdPawn: return StdTables.pawnCaptures[team][pos];
+		case StdBishop: return bishopAttacks(pos, occ);
+		case StdKnight: return StdTables.knight[pos];
+		case StdRook: return rookAttacks(pos, occ);
+		case StdQueen: return rookAttacks(pos, occ) | bishopAttacks(pos, occ);
+		case StdKing: return StdTables.king[pos];
+		default: return 0;
+		}
+	}
+
+	// True if a piece of the given team attacks pos.
+	static bool isAttacked(int pos, bool team, const BoardState& board) {
+		const UINT64* bb = board.pieceBB;
+		UINT64 pcs = board.teamBB[team];
+		UINT64 occ = board.occupied();
+		UINT64 diag = (bb[StdBishop] | bb[StdQueen]) & pcs;
+		UINT64 orth = (bb[StdRook] | bb[StdQueen]) & pcs;
+
+		return (StdTables.pawnAttackers[team][pos] & bb[StdPawn] & pcs) ||
+			(StdTables.knight[pos] & bb[StdKnight] & pcs) ||
+			(StdTables.king[pos] & bb[StdKing] & pcs) ||
+			(diag && (bishopAttacks(pos, occ) & diag)) ||
+			(orth && (rookAttacks(pos, occ) & orth));
+	}
+
+	// Castling of the unmoved king at pos towards the rook in the given direction (King::canCastle).
+	static bool canCastle(int pos, int dir, const BoardState& board) {
+		int rookPos = (pos & ~7) | (dir > 0 ? 7 : 0);
+		byte rook = board[rookPos];
+
+		if ((rook & PIECE_ID) != StdRook || ((rook ^ board[pos]) & PIECE_TEAM)) return false;
+
+		for (int i = pos + dir; i != rookPos; i += dir) {
+			if (board[i] != 0) return false;
+		}
+		return true;
+	}
+
+	// Add the pseudolegal moves of the piece at pos, in the order of its PieceDef::generateMoves.
+	static void generateMoves(int pos, const BoardState& board, MoveList& moves) {
+		byte p = board[pos];
+		bool team = (p & PIECE_TEAM) != 0;
+		UINT64 own = board.teamBB[team];
+
+		switch (p & PIECE_ID) {
+		case StdPawn: {
+			int x = pos & 7, y = pos >> 3;
+			int dir = team ? -1 : 1;
+			if (y == (team ? 0 : 7)) return;
+
+			// Pushes
+			int one = pos + 8 * dir;
+			if (board[one] == 0) {
+				moves.add(pos, one);
+
+				int two = one + 8 * dir;
+				if (!(p & PIECE_MOVED) && y + 2 * dir >= 0 && y + 2 * dir < 8 && board[two] == 0) moves.add(pos, two);
+			}
+			// Capture / en passant case
+			for (int i = -1; i <= 1; i += 2) {
+				if (x + i < 0 || x + i > 7) continue;
+
+				byte cap = board[one + i];
+				byte enp = board[pos + i];
+
+				if ((cap != 0 && ((cap ^ p) & PIECE_TEAM)) ||
+					(cap == 0 && (enp & PIECE_ID) == StdPawn && ((enp ^ p) & PIECE_TEAM) && (enp & PIECE_SPTEMP)))
+					moves.add(pos, one + i);
+			}
+			return;
+		}
+		case StdKing:
+			moves.addTargets(pos, StdTables.king[pos] & ~own);
+			if (p & PIECE_MOVED) return;
+
+			for (int i = -2; i <= 2; i += 4) {
+				int x = (pos & 7) + i;
+				if (x >= 0 && x < 8 && canCastle(pos, i / 2, board)) moves.add(pos, pos + i);
+			}
+			return;
+		default:
+			moves.addTargets(pos, attacks(p & PIECE_ID, pos, team, board.occupied()) & ~own);
+		}
+	}
+
+	// False for the moves changing other squares than start and end (en passant and castling).
+	static bool isPlainMove(Move m, const BoardState& board) {
+		switch (board[m.start] & PIECE_ID) {
+		case StdPawn: return ((m.start ^ m.end) & 7) == 0 || board[m.end] != 0;
+		case StdKing: return abs((m.end & 7) - (m.start & 7)) < 2;
+		default: return true;
+		}
+	}
+
+	// Perform a move like the PieceDef::makeMove of the moved piece. Return true if it must be promoted.
+	static bool makeMove(int start, int end, BoardState& board) {
+		byte p = board[start];
+		int dx = (end & 7) - (start & 7);
+
+		switch (p & PIECE_ID) {
+		case StdPawn: {
+			if (dx != 0 && board[end] == 0) board.set(start + dx, 0);	// En passant capture
+
+			board.set(end, p | PIECE_MOVED);
+			board.set(start, 0);
+			if (abs(end - start) > 9) board.set(end, board[end] | PIECE_SPTEMP);
+
+			return (end >> 3) == 0 || (end >> 3) == 7;
+		}
+		case StdKing:
+			if (abs(dx) >= 2) {
+				int dir = dx > 0 ? 1 : -1;
+				int rookPos = (start & ~7) | (dx > 0 ? 7 : 0);
+
+				board.set(start + 2 * dir, p | PIECE_MOVED);
+				board.set(start, 0);
+				board.set(start + dir, board[rookPos] | PIECE_MOVED);
+				board.set(rookPos, 0);
+				return false;
+			}
+			// Fall through to a plain step
+		default:
+			board.set(end, p | PIECE_MOVED);
+			board.set(start, 0);
+			return false;
+		}
+	}
+
+	// Find the checkers of the king at k and the own pieces pinned to it (ChessRules::findChecksAndPins),
+	// with one ray lookup per direction instead of walking the rays of every enemy slider.
+	static void findChecksAndPins(bool team, int k, const BoardState& board, UINT64& evasion, UINT64& pinned, UINT64* pinRay) {
+		const UINT64* bb = board.pieceBB;
+		UINT64 enemy = board.teamBB[!team];
+		UINT64 occ = board.occupied();
+
+		UINT64 leapers = (StdTables.pawnAttackers[!team][k] & bb[StdPawn]) |
+			(StdTables.knight[k] & bb[StdKnight]) | (StdTables.king[k] & bb[StdKing]);
+		leapers &= enemy;
+		while (leapers) evasion &= SQUARE_BIT(popLsb(leapers));
+
+		for (int d = 0; d < 8; d++) {
+			UINT64 sliders = (bb[d == RayE || d == RayS || d == RayW || d == RayN ? StdRook : StdBishop] | bb[StdQueen]) & enemy;
+			if (!(StdTables.rays[d][k] & sliders)) continue;
+
+			UINT64 blockers = StdTables.rays[d][k] & occ;
+			int first = d < RayW ? lsbIndex(blockers) : msbIndex(blockers);
+			UINT64 path = StdTables.rays[d][k] ^ StdTables.rays[d][first];
+
+			if (sliders & SQUARE_BIT(first)) {
+				evasion &= path;
+				continue;
+			}
+			if (enemy & SQUARE_BIT(first)) continue;
+
+			// An own piece: pinned if the next piece behind it is an enemy slider
+			blockers = StdTables.rays[d][first] & occ;
+			if (!blockers) continue;
+
+			int pinner = d < RayW ? lsbIndex(blockers) : msbIndex(blockers);
+			if (!(sliders & SQUARE_BIT(pinner))) continue;
+
+			path = StdTables.rays[d][k] ^ StdTables.rays[d][pinner];
+			pinRay[first] = (pinned & SQUARE_BIT(first)) ? pinRay[first] & path : path;
+			pinned |= SQUARE_BIT(first);
+		}
+	}
+};
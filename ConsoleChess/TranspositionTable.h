@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include "Platform.h"
+
+// Bound types of a stored score
+enum TTBound : byte {
+	BoundNone = 0,
+	BoundUpper = 1,	// Score is at most the stored value (no move raised alpha)
+	BoundLower = 2,	// Score is at least the stored value (beta cutoff)
+	BoundExact = 3
+};
+
+// Unpacked transposition table entry
+struct TTData {
+	int score;
+	byte start;		// Best move, start == end if none
+	byte end;
+	byte promoteId;
+	int depth;
+	TTBound bound;
+};
+
+// Entries per bucket; a bucket fills a 64-byte cache line
+#define TT_BUCKET_SIZE 4
+
+// Transposition table shared by all search threads without locks.
+// Each entry is two 64-bit words, the data and the key XORed with the data. A torn entry
+// (words from two different writes) fails the key check and reads as a miss,
+// so concurrent writes can only lose entries, never return wrong data.
+class TranspositionTable {
+private:
+	struct Entry {
+		std::atomic<UINT64> check;	// Key ^ data
+		std::atomic<UINT64> data;
+	};
+
+	struct alignas(64) Bucket {
+		Entry entries[TT_BUCKET_SIZE];
+	};
+	static_assert(sizeof(Bucket) == 64, "a bucket should fill one cache line");
+
+	// The buckets are allocated on a cache line boundary, which operator new does not guarantee before C++17
+	struct BucketsDelete {
+		void operator()(Bucket* b) const { alignedFree(b); }
+	};
+
+	std::unique_ptr<Bucket[], BucketsDelete> buckets;
+	UINT64 mask;	// Bucket count - 1 (a power of two)
+	byte age;		// Generation of the current search, to replace stale entries first
+
+	// Data layout: score (32 bits), start (6), end (6), promotion id (4), depth (8), bound (2), age (6)
+	static UINT64 pack(const TTData& d, byte age) {
+		return (UINT64)(unsigned int)d.score | (UINT64)(d.start & 63) << 32 | (UINT64)(d.end & 63) << 38 |
+			(UINT64)(d.promoteId & 15) << 44 | (UINT64)(d.depth & 255) << 48 | (UINT64)d.bound << 56 | (UINT64)(age & 63) << 58;
+	}
+
+	static TTData unpack(UINT64 v) {
+		TTData d;
+		d.score = (int)(unsigned int)(v & 0xFFFFFFFF);
+		d.start = (v >> 32) & 63;
+		d.end = (v >> 38) & 63;
+		d.promoteId = (v >> 44) & 15;
+		d.depth = (v >> 48) & 255;
+		d.bound = (TTBound)((v >> 56) & 3);
+		return d;
+	}
+
+	static byte ageOf(UINT64 v) { return (v >> 58) & 63; }
+
+public:
+	TranspositionTable() : mask(0), age(0) {};
+
+	// Allocate the table with the largest power of two bucket count fitting in the given size, and clear it.
+	void resize(size_t megabytes) {
+		size_t n = 1;
+		while (n * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024) n *= 2;
+
+		buckets.reset();
+		Bucket* b = (Bucket*)alignedAlloc(n * sizeof(Bucket), alignof(Bucket));
+		if (b == NULL) throw std::bad_alloc();
+		for (size_t i = 0; i < n; i++) new (&b[i]) Bucket();
+
+		buckets.reset(b);
+		mask = n - 1;
+		clear();
+	}
+
+	// Size of the table in megabytes
+	size_t sizeMb() const {
+		return buckets ? (mask + 1) * sizeof(Bucket) / (1024 * 1024) : 0;
+	}
+
+	void clear() {
+		for (UINT64 i = 0; buckets && i <= mask; i++) {
+			for (int j = 0; j < TT_BUCKET_SIZE; j++) {
+				buckets[i].entries[j].check.store(0, std::memory_order_relaxed);
+				buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+			}
+		}
+		age = 0;
+	}
+
+	// Start a new search generation. Call while no thread is searching.
+	void newSearch() {
+		age = (age + 1) & 63;
+	}
+
+	// Look up a position key. Return false on a miss.
+	bool probe(UINT64 key, TTData& out) const {
+		if (!buckets) return false;
+		const Bucket& b = buckets[key & mask];
+
+		for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+			UINT64 data = b.entries[i].data.load(std::memory_order_relaxed);
+			UINT64 check = b.entries[i].check.load(std::memory_order_relaxed);
+
+			if ((check ^ data) == key && data != 0) {
+				out = unpack(data);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Store a search result. Replaces the entry of the same key, else the shallowest / oldest entry of the bucket.
+	void store(UINT64 key, const TTData& d) {
+		if (!buckets) return;
+		Bucket& b = buckets[key & mask];
+		Entry* victim = &b.entries[0];
+		int victimScore = 1 << 30;
+
+		for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+			Entry& e = b.entries[i];
+			UINT64 data = e.data.load(std::memory_order_relaxed);
+
+			if ((e.check.load(std::memory_order_relaxed) ^ data) == key) {
+				// Keep a deeper result of this search unless the new one is exact
+				if (ageOf(data) == age && unpack(data).depth > d.depth && d.bound != BoundExact) return;
+				victim = &e;
+				break;
+			}
+
+			// Entries of older searches count as shallower
+			int score = unpack(data).depth - 8 * ((age - ageOf(data)) & 63);
+			if (score < victimScore) {
+				victimScore = score;
+				victim = &e;
+			}
+		}
+
+		UINT64 data = pack(d, age);
+		victim->data.store(data, std::memory_order_relaxed);
+		victim->check.store(key ^ data, std::memory_order_relaxed);
+	}
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "ChessGame.h"
+#include "FramebufferOutput.h"
+#include "StandardPieces.h"
+
+// End-to-end benchmark of the game UI without a console. Scripted scenarios drive ChessGame with
+// mouse events, and every frame's time is split into drawing the layers (redraw), compositing,
+// diffing against the screen and output emission (see FrameStats).
+//
+// Each event waits for the legal moves of a new position and flushes its redraw right away,
+// so every scripted event is measured as a frame.
+//
+// Usage: uibench [--iterations <n>] [--output ansi|framebuffer] [--json | --csv]
+// The ansi output builds its escape sequences in memory without writing them anywhere.
+
+// Phases of a frame, in the order of FrameStats
+static const char* const UiBenchPhases[5] = { "draw", "composite", "diff", "output", "total" };
+
+struct UiBenchScenario {
+	std::string name;
+	std::vector<FrameStats> frames;
+
+	// Sorted times of a phase, in microseconds
+	std::vector<double> times(int phase) const {
+		std::vector<double> t;
+		for (const FrameStats& f : frames) {
+			double us[4] = { f.drawUs, f.compositeUs, f.diffUs, f.outputUs };
+			t.push_back(phase < 4 ? us[phase] : us[0] + us[1] + us[2] + us[3]);
+		}
+		std::sort(t.begin(), t.end());
+		return t;
+	}
+
+	double meanCells() const {
+		double sum = 0;
+		for (const FrameStats& f : frames) sum += f.cells;
+		return frames.empty() ? 0 : sum / frames.size();
+	}
+};
+
+// Percentile of sorted values (nearest rank)
+inline double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) return 0;
+	size_t rank = (size_t)std::ceil(p / 100 * sorted.size());
+	return sorted[(std::max)(rank, (size_t)1) - 1];
+}
+
+class UiBench {
+private:
+	ChessGame& game;
+
+	void mouse(int x, int y, bool click) {
+		MOUSE_EVENT_RECORD evt = MOUSE_EVENT_RECORD();
+		evt.dwMousePosition.X = x;
+		evt.dwMousePosition.Y = y;
+		evt.dwButtonState = click ? RI_MOUSE_BUTTON_1_DOWN : 0;
+		evt.dwEventFlags = click ? 0 : MOUSE_MOVED;
+		game.onMouse(evt);
+		game.awaitMoves();
+		game.flush();
+	}
+
+	// Move to the middle of a board square (index y << 3 | x), then click it if asked
+	void square(int sq, bool click) {
+		mouse((sq & 7) * 8 + 4, (sq >> 3) * 8 + 4, false);
+		if (click) mouse((sq & 7) * 8 + 4, (sq >> 3) * 8 + 4, true);
+	}
+
+	void restart() {
+		mouse(70, 55, false);
+		mouse(70, 55, true);
+	}
+
+	// Hover and click the first piece of the promotion menu
+	void promoteFirst() {
+		mouse(80, 13, false);
+		mouse(80, 13, true);
+	}
+
+	// Click a move picked by rng, promoting to the first piece offered
+	void playMove(std::mt19937& rng) {
+		MoveList moves;
+		game.generateLegalMoves(game.currTeam, moves);
+		Move m = moves[rng() % moves.size];
+		square(m.start, true);
+		square(m.end, true);
+		if (game.state() == Promoting) promoteFirst();
+	}
+
+public:
+	UiBench(ChessGame& game) : game(game) {};
+
+	// Sweep the mouse over all 64 squares and off the board
+	void hoverSweep(int iterations) {
+		game.beginGame();
+		game.awaitMoves();
+		game.flush();
+		for (int i = 0; i < iterations; i++) {
+			for (int sq = 0; sq < 64; sq++) square(sq, false);
+			mouse(100, 40, false);
+		}
+	}
+
+	// Select every piece of the side to move that has a move, one after the other
+	void selectStorm(int iterations) {
+		game.beginGame();
+		game.awaitMoves();
+		game.flush();
+		MoveList moves;
+		game.generateLegalMoves(game.currTeam, moves);
+
+		for (int i = 0; i < iterations; i++) {
+			for (int m = 0; m < moves.size; m++) {
+				if (m == 0 || moves[m].start != moves[m - 1].start) square(moves[m].start, true);
+			}
+		}
+	}
+
+	// Play moves picked by a fixed seed through clicks, 80 per side per iteration,
+	// restarting whenever a game ends and promoting to the first piece offered
+	void fullGame(int iterations) {
+		std::mt19937 rng(80);
+
+		for (int i = 0; i < iterations; i++) {
+			game.beginGame();
+			game.awaitMoves();
+			game.flush();
+			for (int ply = 0; ply < 160; ply++) {
+				if (game.state() != InProgress) restart();
+				playMove(rng);
+			}
+		}
+	}
+
+	// Open the promotion menu, hover its entries and pick one
+	void promotionMenu(int iterations) {
+		for (int i = 0; i < iterations; i++) {
+			game.loadPosition("4k3/P7/8/8/8/8/8/4K3 w - - 0 1");
+			game.awaitMoves();
+			game.flush();
+			square(8, true);	// a7
+			square(0, true);	// a8
+			for (int j = 0; j < 4; j++) mouse(80 + 10 * j, 13, false);
+			promoteFirst();
+		}
+	}
+
+	// Play a few moves and restart, so every restart has a board to reset
+	void restarts(int iterations) {
+		std::mt19937 rng(4);
+
+		for (int i = 0; i < iterations; i++) {
+			for (int ply = 0; ply < 4 && game.state() == InProgress; ply++) playMove(rng);
+			restart();
+		}
+	}
+};
+
+int runUiBench(int argc, char* argv[]) {
+	int iterations = 10;
+	bool json = false, csv = false, framebuffer = false;
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = (std::max)(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) framebuffer = strcmp(argv[++i], "framebuffer") == 0;
+		else if (strcmp(argv[i], "--json") == 0) json = true;
+		else if (strcmp(argv[i], "--csv") == 0) csv = true;
+		else {
+			printf("usage: uibench [--iterations <n>] [--output ansi|framebuffer] [--json | --csv]\n");
+			return 1;
+		}
+	}
+
+	StandardPieces set;
+	ChessGame game(set.pieces(), StandardPieces::startingBoard());
+	if (framebuffer) game.setOutput(new FramebufferOutput());
+	else game.setOutput(new AnsiOutput(NULL));
+	game.beginGame();
+	game.awaitMoves();
+	game.flush();
+
+	UiBench bench(game);
+	std::vector<UiBenchScenario> scenarios;
+	auto run = [&](const char* name, void (UiBench::*scenario)(int)) {
+		scenarios.push_back(UiBenchScenario());
+		UiBenchScenario& s = scenarios.back();
+		s.name = name;
+
+		game.onFrame([&s](const FrameStats& f) { s.frames.push_back(f); });
+		(bench.*scenario)(iterations);
+		game.onFrame(NULL);
+	};
+
+	run("hover", &UiBench::hoverSweep);
+	run("select", &UiBench::selectStorm);
+	run("game", &UiBench::fullGame);
+	run("promotion", &UiBench::promotionMenu);
+	run("restart", &UiBench::restarts);
+	MoveWorkerStats moves = game.moveStats();
+
+	if (json) {
+		printf("{\"output\":\"%s\",\"iterations\":%d,\"scenarios\":[", framebuffer ? "framebuffer" : "ansi", iterations);
+		for (size_t i = 0; i < scenarios.size(); i++) {
+			const UiBenchScenario& s = scenarios[i];
+			printf("%s{\"name\":\"%s\",\"frames\":%d,\"cells\":%.1f,\"phases\":{", i ? "," : "", s.name.c_str(), (int)s.frames.size(), s.meanCells());
+			for (int p = 0; p < 5; p++) {
+				std::vector<double> t = s.times(p);
+				printf("%s\"%s\":{\"p50\":%.2f,\"p99\":%.2f,\"max\":%.2f}", p ? "," : "", UiBenchPhases[p],
+					percentile(t, 50), percentile(t, 99), t.empty() ? 0.0 : t.back());
+			}
+			printf("}}");
+		}
+		printf("],\"legalMoves\":{\"cacheHits\":%llu,\"cacheMisses\":%llu,\"speculativeHits\":%llu,\"cached\":%d}}\n",
+			(unsigned long long)moves.cacheHits, (unsigned long long)moves.cacheMisses, (unsigned long long)moves.speculativeHits, (int)moves.cached);
+	}
+	else if (csv) {
+		printf("scenario,phase,frames,p50_us,p99_us,max_us\n");
+		for (const UiBenchScenario& s : scenarios) {
+			for (int p = 0; p < 5; p++) {
+				std::vector<double> t = s.times(p);
+				printf("%s,%s,%d,%.2f,%.2f,%.2f\n", s.name.c_str(), UiBenchPhases[p], (int)s.frames.size(),
+					percentile(t, 50), percentile(t, 99), t.empty() ? 0.0 : t.back());
+			}
+		}
+	}
+	else {
+		printf("Scenario   Frames  Cells   Phase      p50 (us)  p99 (us)  max (us)\n");
+		for (const UiBenchScenario& s : scenarios) {
+			for (int p = 0; p < 5; p++) {
+				std::vector<double> t = s.times(p);
+				if (p == 0) printf("%-10s %-7d %-7.1f ", s.name.c_str(), (int)s.frames.size(), s.meanCells());
+				else printf("%-26s ", "");
+				printf("%-10s %-9.2f %-9.2f %.2f\n", UiBenchPhases[p], percentile(t, 50), percentile(t, 99), t.empty() ? 0.0 : t.back());
+			}
+		}
+		printf("Legal moves: %llu precomputed, %llu cache hits, %llu misses, %d positions cached\n", (unsigned long long)moves.speculativeHits,
+			(unsigned long long)moves.cacheHits, (unsigned long long)moves.cacheMisses, (int)moves.cached);
+	}
+	return 0;
+}
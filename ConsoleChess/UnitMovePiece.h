@@ -1,7 +1,8 @@
 #pragma once
-#include <Windows.h>
+#include "Platform.h"
 #include <vector>
 #include "PieceDef.h"
+#include "SliderAttacks.h"
 #include <algorithm>
 
 // Enum defining the types of symmetry that can be applied to unit moves. 
@@ -18,10 +19,70 @@ class UnitMovePiece : public PieceDef {
 private:
 	byte moveset[256];
 
+	// Attack tables derived from the moveset by buildAttackTables()
+	bool sliding;			// Moves repeat and can be blocked
+	UINT64 leapTable[64];	// Per target square: squares a non-sliding move reaches it from
+	UINT64 leapAttacks[64];	// Per square: squares a non-sliding move reaches from it
+	IVec2 rays[32];			// Unit vectors of the sliding moves
+	int nRays;
+	SliderTable slideTable;		// Occupancy-indexed attacks along the rays
+	SliderTable reverseTable;	// Same along the reversed rays, if the rays are not symmetric
+	bool symmetric;
+
+	// Precompute the attack tables from the moveset and its (symmetry expanded) unit moves.
+	void buildAttackTables(const std::vector<IVec2>& unitMoves, bool repeat) {
+		sliding = repeat && !canJump;
+		nRays = 0;
+		std::fill_n(leapTable, 64, 0);
+		std::fill_n(leapAttacks, 64, 0);
+
+		for (int i = 0; i < 256; i++) {
+			if (moveset[i] == 0) continue;
+			IVec2 d = IVec2((i & 0xF) - 8, (i >> 4) - 8);
+
+			if (!sliding) {
+				// Any square of the moveset is reached directly
+				for (int k = 0; k < 64; k++) {
+					IVec2 from = IVec2(k & 7, k >> 3) - d;
+					IVec2 to = IVec2(k & 7, k >> 3) + d;
+					if (from.in88Square()) leapTable[k] |= SQUARE_BIT(POS_TO_INDEX(from));
+					if (to.in88Square()) leapAttacks[k] |= SQUARE_BIT(POS_TO_INDEX(to));
+				}
+			}
+		}
+
+		if (!sliding) return;
+
+		// Ray directions in unit move order, so related rays share a table lookup
+		for (size_t i = 0; i < unitMoves.size() && nRays < 32; i++) {
+			IVec2 u = unitMoves[i];
+			if (moveset[(u.y + 8) << 4 | (u.x + 8)] != 0x88) continue;
+			if (std::find(rays, rays + nRays, u) != rays + nRays) continue;
+
+			rays[nRays++] = u;
+		}
+
+		// Reverse queries walk the rays backwards, which is the same table for symmetric movesets
+		IVec2 reversed[32];
+		symmetric = true;
+		for (int r = 0; r < nRays; r++) {
+			reversed[r] = IVec2(-rays[r].x, -rays[r].y);
+			symmetric &= moveset[(reversed[r].y + 8) << 4 | (reversed[r].x + 8)] == 0x88;
+		}
+
+		slideTable.build(rays, nRays);
+		if (!symmetric) reverseTable.build(reversed, nRays);
+	}
+
 public:
 	bool canJump;
 
-	UnitMovePiece(byte id, bool critical, bool canJump, Byte88 sprite) : moveset{ } {
+	// Squares attacked from a given index, including the first blocker of each sliding ray.
+	UINT64 attacks(int pos, UINT64 occ) const {
+		return sliding ? slideTable.attacks(pos, occ) : leapAttacks[pos];
+	}
+
+	UnitMovePiece(byte id, bool critical, bool canJump, Byte88 sprite) : moveset{ }, sliding(false), leapTable{ }, leapAttacks{ }, nRays(0), symmetric(true) {
 		this->id = id;
 		this->critical = critical;
 		this->canJump = canJump;
@@ -75,10 +136,12 @@ public:
 
 			} while (repeat && abs(delta.x) < 8 && abs(delta.y) < 8);
 		}
+
+		buildAttackTables(unitMoves, repeat);
 	}
 
 	// Check if potential move is pseudolegal
-	bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) override {
+	bool isValidMove(IVec2 start, IVec2 end, const BoardState &board) const override {
 		if (board[end] != 0 && board.getPiece(end).team == board.getPiece(start).team) { return false; }
 		IVec2 delta = end - start;
 
@@ -88,6 +151,11 @@ public:
 
 		else if (canJump) return true; 
 
+		// Sliding moves: blockers are resolved by the occupancy-indexed table
+		else if (sliding) {
+			return (slideTable.attacks(POS_TO_INDEX(start), board.occupied()) >> POS_TO_INDEX(end)) & 1;
+		}
+
 		else {
 			// Jump to previous positions on the move path until the 0 delta
 			while (moveset[i] != 0x88) {
@@ -99,5 +167,37 @@ public:
 			return true;
 		}
 	}
+
+	void generateMoves(IVec2 start, const BoardState& board, MoveList& moves) const override {
+		int pos = POS_TO_INDEX(start);
+		UINT64 own = board.teamBB[board.getPiece(pos).team];
+
+		moves.addTargets(pos, attacks(pos, board.occupied()) & ~own);
+	}
+
+	bool describesAttacks() const override {
+		return true;
+	}
+
+	UINT64 attacks(int pos, bool team, UINT64 occ) const override {
+		return attacks(pos, occ);
+	}
+
+	int slideRays(IVec2* rays) const override {
+		if (!sliding) return 0;
+
+		std::copy_n(this->rays, nRays, rays);
+		return nRays;
+	}
+
+	UINT64 attackers(IVec2 pos, bool team, const BoardState& board) const override {
+		UINT64 own = board.pieces(id, team);
+
+		if (!sliding) return leapTable[POS_TO_INDEX(pos)] & own;
+
+		// Attacks along the reversed rays end on the first piece met in each direction
+		const SliderTable& table = symmetric ? slideTable : reverseTable;
+		return table.attacks(POS_TO_INDEX(pos), board.occupied()) & own;
+	}
 };
 
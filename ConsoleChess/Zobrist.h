@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Platform.h"
+
+// Random keys for hashing board positions. A square's key depends on its whole piece byte:
+// the id and team bits (low 5 bits) select one key and the moved / special flags (high 3 bits) another.
+struct ZobristKeys {
+	UINT64 piece[64][32];
+	UINT64 flags[64][8];
+	UINT64 side;	// Toggled when white (team 1) is to move
+
+	ZobristKeys() {
+		UINT64 state = 0x2545F4914F6CDD1DULL;
+
+		for (int i = 0; i < 64; i++) {
+			for (int j = 0; j < 32; j++) piece[i][j] = (j == 0) ? 0 : next(state);
+			for (int j = 0; j < 8; j++) flags[i][j] = (j == 0) ? 0 : next(state);
+		}
+		side = next(state);
+	}
+
+	// Key of a piece byte on a given square (0 for an empty square).
+	UINT64 key(int pos, byte b) const {
+		return piece[pos][b & 0x1F] ^ flags[pos][b >> 5];
+	}
+
+private:
+	static UINT64 next(UINT64& state) {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 2685821657736338717ULL;
+	}
+};
+
+static const ZobristKeys Zobrist;